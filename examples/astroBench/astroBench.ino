@@ -0,0 +1,91 @@
+#define __ESP__  // or other ustd library platform define
+#include "scheduler.h"
+#include "helper/mup_astro.h"
+
+// Benchmark and accuracy check for the double, single precision and fixed point sun event
+// calculations of the Astro helper. Every 10 seconds, the sunrise, sunset and twilight times
+// of one year are calculated for a few latitudes with all three variants. The average time per
+// call and the maximum deviation of the float and fixed point results from the double results
+// are printed to the serial port.
+
+#define BENCH_YEAR 2026
+
+ustd::Scheduler sched;
+
+const double latitudes[] = {0.0, 35.0, 48.1374, 60.0, 65.0};
+const double zeniths[] = {ustd::C_ZENITH_OFFICIAL, ustd::C_ZENITH_CIVIL,
+                          ustd::C_ZENITH_NAUTICAL};
+const double longitude = 11.5755;
+uint8_t latIndex = 0;
+volatile double sink;
+
+double deviation(double ut, double reference) {
+    // deviation in seconds, across midnight
+    double d = fabs(ut - reference) * 3600.0;
+    return d > 43200.0 ? 86400.0 - d : d;
+}
+
+void appLoop() {
+    double lat = latitudes[latIndex];
+    latIndex = (latIndex + 1) % (sizeof(latitudes) / sizeof(latitudes[0]));
+    unsigned long timeDouble = 0, timeFloat = 0, timeFixed = 0, calls = 0, start;
+    double maxFloat = 0.0, maxFixed = 0.0;
+    for (int month = 1; month <= 12; month++) {
+        for (int day = 1; day <= 28; day += 3) {
+            for (uint8_t z = 0; z < 3; z++) {
+                for (uint8_t rising = 0; rising < 2; rising++) {
+                    double ut;
+                    float utFloat;
+                    int32_t utFixed;
+
+                    start = micros();
+                    int8_t ret = ustd::Astro::calculateSunEvent(BENCH_YEAR, month, day, lat,
+                                                                longitude, zeniths[z], rising, &ut);
+                    timeDouble += micros() - start;
+
+                    start = micros();
+                    ustd::Astro::calculateSunEventFloat(BENCH_YEAR, month, day, lat, longitude,
+                                                        zeniths[z], rising, &utFloat);
+                    timeFloat += micros() - start;
+
+                    start = micros();
+                    ustd::Astro::calculateSunEventFixed(
+                        BENCH_YEAR, month, day, ustd::Astro::toFixed(lat),
+                        ustd::Astro::toFixed(longitude), ustd::Astro::toFixed(zeniths[z]),
+                        rising, &utFixed);
+                    timeFixed += micros() - start;
+
+                    ++calls;
+                    if (ret == 0) {
+                        maxFloat = max(maxFloat, deviation(utFloat, ut));
+                        maxFixed = max(maxFixed, deviation(utFixed / 3600.0, ut));
+                        sink = ut;
+                    }
+                }
+            }
+        }
+    }
+    Serial.print("lat ");
+    Serial.print(lat, 4);
+    Serial.print(": double ");
+    Serial.print(timeDouble / calls);
+    Serial.print(" us, float ");
+    Serial.print(timeFloat / calls);
+    Serial.print(" us (max ");
+    Serial.print(maxFloat, 1);
+    Serial.print(" s), fixed ");
+    Serial.print(timeFixed / calls);
+    Serial.print(" us (max ");
+    Serial.print(maxFixed, 1);
+    Serial.println(" s)");
+}
+
+void setup() {
+    Serial.begin(115200);
+    sched.add(appLoop, "main", 10000000);
+}
+
+// Never add code to this loop, use appLoop() instead.
+void loop() {
+    sched.loop();
+}
@@ -0,0 +1,87 @@
+#define __ESP__  // or other ustd library platform define
+#include "scheduler.h"
+#include "mupplet_core.h"
+
+// Benchmark for the number formatting functions of mupplet_core compared to the sprintf()
+// calls that were used by the mupplets before. The results are printed to the serial port
+// every 10 seconds as average time per call in nanoseconds.
+
+#define BENCH_ITERATIONS 10000
+
+ustd::Scheduler sched;
+
+volatile char sink;
+double values[16];
+
+unsigned long nsPerCall(unsigned long startUs) {
+    return (micros() - startUs) * 1000UL / BENCH_ITERATIONS;
+}
+
+void report(const char *name, unsigned long reference, unsigned long formatter) {
+    Serial.print(name);
+    Serial.print(": sprintf ");
+    Serial.print(reference);
+    Serial.print(" ns, mupplet_core ");
+    Serial.print(formatter);
+    Serial.println(" ns");
+}
+
+void appLoop() {
+    char buf[32];
+    unsigned long start, reference, formatter;
+
+    start = micros();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sprintf(buf, "%5.3f", values[i & 15]);
+        sink = buf[2];
+    }
+    reference = nsPerCall(start);
+    start = micros();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ustd::formatFixed(buf, values[i & 15], 3);
+        sink = buf[2];
+    }
+    formatter = nsPerCall(start);
+    report("unitbrightness", reference, formatter);
+
+    start = micros();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sprintf(buf, "%10.3f", values[i & 15] * 12345.0);
+        sink = buf[2];
+    }
+    reference = nsPerCall(start);
+    start = micros();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ustd::formatFixed(buf, values[i & 15] * 12345.0, 3);
+        sink = buf[2];
+    }
+    formatter = nsPerCall(start);
+    report("frequency", reference, formatter);
+
+    start = micros();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        sprintf(buf, "%ld", (long)i * 7919);
+        sink = buf[2];
+    }
+    reference = nsPerCall(start);
+    start = micros();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ustd::formatLong(buf, (long)i * 7919);
+        sink = buf[2];
+    }
+    formatter = nsPerCall(start);
+    report("counter", reference, formatter);
+}
+
+void setup() {
+    Serial.begin(115200);
+    for (int i = 0; i < 16; i++) {
+        values[i] = (double)random(0, 100000) / 100000.0;
+    }
+    sched.add(appLoop, "main", 10000000);
+}
+
+// Never add code to this loop, use appLoop() instead.
+void loop() {
+    sched.loop();
+}
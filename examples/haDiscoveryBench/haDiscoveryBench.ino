@@ -0,0 +1,82 @@
+#define __ESP__  // or other ustd library platform define
+#include "scheduler.h"
+#include "home_assistant.h"
+
+// Benchmark for the HomeAssistant discovery. No network connection is required: the MQTT
+// connection is simulated by publishing the messages normally sent by the MQTT module, and the
+// configuration messages stay on the local message bus.
+//
+// Set BENCH_CONFIGS to 10, 100 or 1000 (1000 requires an ESP32). The entities are a mix of
+// sensors, binary sensors, switches and multichannel RGB lights with effect lists. The sketch
+// alternates between publishing and removing all configurations and prints the statistics
+// reported on `ha/discovery` to the serial port.
+//
+// The allocation count of the discovery job (`allocs`, `alloc_bytes`) is only reported with the
+// allocation counting of the mupplet profiler, e.g. in platformio.ini:
+//
+//   build_flags =
+//       -D__USE_MUPPLET_ALLOC_COUNTING__
+//       -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+
+#define BENCH_CONFIGS 100
+#define BENCH_LIGHT_CHANNELS 10
+
+ustd::Scheduler sched;
+ustd::HomeAssistant ha("Bench", "muwerk", "Discovery Benchmark", "1.0.0");
+
+bool publishing = false;
+
+void addEntities() {
+    // 10% sensors, 10% binary sensors, 10% switches, the rest multichannel lights
+    int each = BENCH_CONFIGS / 10;
+    for (int i = 0; i < each; i++) {
+        ha.addSensor("sensor" + String(i), "temperature", "", "temperature", "°C");
+        ha.addBinarySensor("binary" + String(i), "state", "", "motion");
+        ha.addSwitch("relay" + String(i));
+    }
+    for (int i = 0; i < (BENCH_CONFIGS - 3 * each) / BENCH_LIGHT_CHANNELS; i++) {
+        ha.addMultiLight("panel" + String(i), BENCH_LIGHT_CHANNELS, "",
+                         ustd::HomeAssistant::LightRGB);
+    }
+    ha.addLight("strip", "", ustd::HomeAssistant::LightRGB, "", "",
+                "Static, Butterlamp, Fireplace, Wave, Rainbow");
+}
+
+void onDiscovery(String topic, String msg, String originator) {
+    Serial.println("ha/discovery: " + msg);
+}
+
+void appLoop() {
+    if (ha.isDiscoveryRunning()) {
+        return;
+    }
+    // alternate between publishing and removing all configurations
+    publishing = !publishing;
+    if (publishing) {
+        ha.setAutoDiscovery(true);
+        if (!ha.isDiscoveryRunning()) {
+            // autodiscovery was already enabled, force a full republish
+            ha.refreshDiscovery();
+        }
+    } else {
+        ha.setAutoDiscovery(false);
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    ha.begin(&sched, false);
+    addEntities();
+
+    int tid = sched.add(appLoop, "main", 5000000);
+    sched.subscribe(tid, "ha/discovery", onDiscovery);
+
+    // simulate an established MQTT connection
+    sched.publish("mqtt/config", "omu/bench+omu/bench/mqtt/state+disconnected");
+    sched.publish("mqtt/state", "connected");
+}
+
+// Never add code to this loop, use appLoop() instead.
+void loop() {
+    sched.loop();
+}
@@ -0,0 +1,70 @@
+#define __ESP__  // or other ustd library platform define
+#include "scheduler.h"
+#include "mup_light.h"
+#include "mup_switch.h"
+
+// Allocation benchmark for the message handlers of the mupplets. Requires the allocation
+// counting of the mupplet profiler, e.g. in platformio.ini:
+//
+//   build_flags =
+//       -D__USE_MUPPLET_ALLOC_COUNTING__
+//       -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+//
+// The sketch sends a fixed series of typical commands and state requests to a light and a
+// switch and then prints the table published on `mupplets/allocs`: the number of handled
+// messages, heap allocations and requested bytes per mupplet and topic. Save the output of two
+// firmware releases and diff them to find handlers that allocate more than before. The sketch
+// runs on the target only, the mupplets have no host build.
+
+#ifndef __USE_MUPPLET_ALLOC_COUNTING__
+#error "muppletAllocBench requires __USE_MUPPLET_ALLOC_COUNTING__, see the comment above"
+#endif
+
+#define BENCH_ROUNDS 100
+
+ustd::Scheduler sched;
+ustd::Light led("led", D5);
+ustd::Switch button("button", D6);
+
+const char *benchMessages[][2] = {
+    {"led/light/set", "on"},
+    {"led/light/set", "0.5"},
+    {"led/light/unitbrightness/get", ""},
+    {"led/light/mode/set", "wave 1000"},
+    {"led/light/set", "off"},
+    {"button/switch/set", "toggle"},
+    {"button/switch/state/get", ""},
+    {"button/switch/counter/get", ""},
+};
+
+int benchRound = 0;
+
+void onAllocs(String topic, String msg, String originator) {
+    Serial.println("mupplets/allocs: " + msg);
+}
+
+void appLoop() {
+    if (benchRound < BENCH_ROUNDS) {
+        for (auto &message : benchMessages) {
+            sched.publish(message[0], message[1]);
+        }
+    } else if (benchRound == BENCH_ROUNDS) {
+        // all messages have been handled in the previous ticks
+        sched.publish("mupplets/allocs/get");
+    }
+    ++benchRound;
+}
+
+void setup() {
+    Serial.begin(115200);
+    led.begin(&sched);
+    button.begin(&sched);
+
+    int tid = sched.add(appLoop, "main", 100000);
+    sched.subscribe(tid, "mupplets/allocs", onAllocs);
+}
+
+// Never add code to this loop, use appLoop() instead.
+void loop() {
+    sched.loop();
+}
@@ -0,0 +1,111 @@
+// alloc_counter.h - counting interposer for the heap allocator
+
+#pragma once
+
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+namespace ustd {
+
+// clang-format off
+/*! \brief Heap Allocation Counter
+
+Counts the calls of `malloc()`, `calloc()` and `realloc()` and the number of requested bytes.
+Unlike a comparison of the free heap, this also covers temporary allocations that are released
+again before a function returns, e.g. the `String` copies and concatenations in message
+handlers. `String` uses `malloc()` / `realloc()` and is counted as well, `operator new` is
+replaced by a version that allocates with `malloc()`.
+
+The counter is only compiled with `__USE_MUPPLET_ALLOC_COUNTING__` defined. The allocator is
+interposed with the `--wrap` option of the GNU linker, so the define must be accompanied by the
+matching linker flags, e.g. in `platformio.ini`:
+
+\code{ini}
+build_flags =
+    -D__USE_MUPPLET_ALLOC_COUNTING__
+    -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+\endcode
+
+The same flags work for host builds with gcc or clang on Linux. The counter is not thread-safe
+and is meant for single threaded (cooperative) firmware.
+
+\code{cpp}
+ustd::AllocCounter::Snapshot before = ustd::AllocCounter::get();
+doSomething();
+unsigned long allocs = ustd::AllocCounter::get().count - before.count;
+\endcode
+*/
+// clang-format on
+class AllocCounter {
+  public:
+    /*! \brief Snapshot of the allocation counters */
+    struct Snapshot {
+        unsigned long count;  //!< number of allocations since start
+        unsigned long bytes;  //!< number of requested bytes since start
+    };
+
+    static Snapshot get() {
+        /*! Get the current allocation counters
+        @return Snapshot of the counters
+        */
+        return counters();
+    }
+
+    static void add(size_t bytes) {
+        /*! Record an allocation (called by the allocator wrappers)
+        @param bytes Number of requested bytes
+        */
+        Snapshot &c = counters();
+        ++c.count;
+        c.bytes += bytes;
+    }
+
+  private:
+    static Snapshot &counters() {
+        static Snapshot c = {0, 0};  // constant initialized: usable before static constructors
+        return c;
+    }
+};
+
+}  // namespace ustd
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+// weak: the header can be included by several translation units
+__attribute__((weak)) void *__wrap_malloc(size_t size) {
+    ustd::AllocCounter::add(size);
+    return __real_malloc(size);
+}
+
+__attribute__((weak)) void *__wrap_calloc(size_t count, size_t size) {
+    ustd::AllocCounter::add(count * size);
+    return __real_calloc(count, size);
+}
+
+__attribute__((weak)) void *__wrap_realloc(void *ptr, size_t size) {
+    // growing a String reallocates: every call counts as an allocation
+    ustd::AllocCounter::add(size);
+    return __real_realloc(ptr, size);
+}
+}
+
+// a C++ library that is linked as shared library (host builds) does not use the wrapped malloc
+__attribute__((weak)) void *operator new(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        abort();
+    }
+    return p;
+}
+
+__attribute__((weak)) void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+#endif  // __USE_MUPPLET_ALLOC_COUNTING__
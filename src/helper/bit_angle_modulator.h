@@ -0,0 +1,289 @@
+// bit_angle_modulator.h - software PWM for many GPIOs using bit angle modulation
+
+#pragma once
+
+#include "ustd_platform.h"
+#include "helper/output_backend.h"
+
+namespace ustd {
+
+#if defined(__ESP32__) || defined(__ESP__)
+#define G_INT_ATTR IRAM_ATTR
+#else
+#define G_INT_ATTR
+#endif
+
+#define USTD_BAM_MAX_CHANNELS (32)
+#define USTD_BAM_BITS (8)
+
+// Precomputed port masks for each bit of the modulation cycle. There are two frames: the
+// active frame is used by the timer interrupt, the other one is prepared by the application
+// and swapped in at the end of a modulation cycle.
+volatile uint32_t ustd_bam_set_mask[2][USTD_BAM_BITS];
+volatile uint32_t ustd_bam_clr_mask[2][USTD_BAM_BITS];
+volatile uint32_t ustd_bam_ticks[USTD_BAM_BITS];
+volatile uint8_t ustd_bam_frame = 0;
+volatile bool ustd_bam_frame_pending = false;
+volatile uint8_t ustd_bam_bit = 0;
+#ifdef __ESP32__
+hw_timer_t *ustd_bam_timer = nullptr;
+#endif
+void *ustd_bam_owner = nullptr;  // the modulator that owns the masks and the timer
+
+// This interrupt is triggered by the hardware timer at the end of each bit period. It outputs
+// the port masks of the next bit and programs the timer to the duration of that bit.
+void G_INT_ATTR ustd_bam_isr() {
+    uint8_t bit = ustd_bam_bit;
+    uint8_t frame = ustd_bam_frame;
+#if defined(__ESP32__)
+    REG_WRITE(GPIO_OUT_W1TS_REG, ustd_bam_set_mask[frame][bit]);
+    REG_WRITE(GPIO_OUT_W1TC_REG, ustd_bam_clr_mask[frame][bit]);
+    timerAlarmWrite(ustd_bam_timer, ustd_bam_ticks[bit], true);
+#elif defined(__ESP__)
+    GPOS = ustd_bam_set_mask[frame][bit];
+    GPOC = ustd_bam_clr_mask[frame][bit];
+    timer1_write(ustd_bam_ticks[bit]);
+#endif
+    if (++bit == USTD_BAM_BITS) {
+        bit = 0;
+        if (ustd_bam_frame_pending) {
+            ustd_bam_frame = frame ^ 1;
+            ustd_bam_frame_pending = false;
+        }
+    }
+    ustd_bam_bit = bit;
+}
+
+// clang-format off
+/*! \brief mupplet-core Bit Angle Modulator
+
+The bit angle modulator allows to dim up to 32 plain GPIOs with 8 bit resolution using a
+single hardware timer. Unlike PWM, bit angle modulation outputs each bit of the brightness
+value for a duration proportional to its weight: bit 0 for one base period, bit 1 for two base
+periods, up to bit 7 for 128 base periods. A full modulation cycle therefore needs only 8 timer
+interrupts, independent of the number of channels.
+
+The port masks for every bit are precomputed whenever a level changes, so that each timer
+interrupt only writes the precomputed masks into the GPIO set and clear registers. Changes are
+double-buffered and become active at the start of the next modulation cycle.
+
+The modulator is an \ref OutputBackend and can be used by \ref Light and \ref DigitalOut
+instead of a GPIO port.
+
+Supported platforms are ESP8266 (GPIO 0-15, uses `timer1`) and ESP32 (GPIO 0-31, uses one of the
+hardware timers). The port masks and the timer are shared by all instances, so only one
+modulator can run at any time: \ref begin() of a second instance fails while the first one is
+running, and a modulator that is not running never touches the masks of the running one.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "helper/bit_angle_modulator.h"
+#include "mup_light.h"
+
+ustd::Scheduler sched;
+ustd::BitAngleModulator bam;
+ustd::Light led1("led1", &bam, bam.addPort(D5));  // only records the port
+ustd::Light led2("led2", &bam, bam.addPort(D6));
+
+void setup() {
+    bam.begin();  // configures the ports and starts the timer
+    led1.begin(&sched);
+    led2.begin(&sched);
+}
+\endcode
+*/
+// clang-format on
+class BitAngleModulator : public OutputBackend {
+  public:
+    static const char *version;  // = "0.1.0";
+
+  private:
+    // configuration
+    unsigned long baseUs;
+    uint8_t timerNo;
+
+    // channels
+    uint8_t ports[USTD_BAM_MAX_CHANNELS];
+    uint8_t levels[USTD_BAM_MAX_CHANNELS];
+    uint8_t count = 0;
+    uint32_t portMask = 0;
+
+    // runtime
+    bool active = false;
+
+  public:
+    BitAngleModulator(unsigned long baseUs = 16, uint8_t timerNo = 0)
+        : baseUs(baseUs), timerNo(timerNo) {
+        /*! Instantiate a bit angle modulator
+
+        No hardware interaction is performed, until \ref begin() is called.
+
+        @param baseUs Duration of the least significant bit in microseconds. A full modulation
+                      cycle lasts 255 * baseUs, the default of 16us results in a modulation
+                      frequency of about 245Hz.
+        @param timerNo ESP32 only: number of the hardware timer used by the modulator.
+        */
+    }
+
+    virtual ~BitAngleModulator() {
+        end();
+    }
+
+    int8_t addPort(uint8_t port) {
+        /*! Add a GPIO port to the modulator
+
+        Only the port is recorded, so this can be called from global constructors. The port
+        is configured as output and driven LOW by \ref begin() (immediately, if the
+        modulator is already running).
+
+        @param port GPIO port number (ESP8266: 0-15, ESP32: 0-31)
+        @return Channel number of the port or -1, if the port is not supported or the maximum
+                number of channels is reached.
+        */
+#if defined(__ESP32__)
+        if (port > 31)
+            return -1;
+#elif defined(__ESP__)
+        if (port > 15)
+            return -1;
+#else
+        return -1;
+#endif
+        if (count >= USTD_BAM_MAX_CHANNELS)
+            return -1;
+        for (uint8_t i = 0; i < count; i++) {
+            if (ports[i] == port)
+                return i;
+        }
+        if (active) {
+            pinMode(port, OUTPUT);
+            digitalWrite(port, LOW);
+        }
+        ports[count] = port;
+        levels[count] = 0;
+        portMask |= (uint32_t)1 << port;
+        ++count;
+        update();
+        return count - 1;
+    }
+
+    bool begin() {
+        /*! Configure the ports and start the hardware timer and the modulation
+        @return `true` on success, `false` if the platform is not supported or another
+                modulator is running.
+        */
+        if (active)
+            return true;
+#if defined(__ESP32__) || defined(__ESP__)
+        if (ustd_bam_owner)
+            return false;
+        ustd_bam_owner = this;
+        for (uint8_t i = 0; i < count; i++) {
+            pinMode(ports[i], OUTPUT);
+            digitalWrite(ports[i], LOW);
+        }
+        update();
+        ustd_bam_frame ^= 1;  // the timer is not running yet: start with the prepared frame
+        ustd_bam_frame_pending = false;
+#endif
+        for (uint8_t bit = 0; bit < USTD_BAM_BITS; bit++) {
+#if defined(__ESP32__)
+            ustd_bam_ticks[bit] = baseUs << bit;  // 1MHz timer clock
+#else
+            ustd_bam_ticks[bit] = (baseUs * 5) << bit;  // 5MHz timer clock (TIM_DIV16)
+#endif
+        }
+        ustd_bam_bit = 0;
+#if defined(__ESP32__)
+        ustd_bam_timer = timerBegin(timerNo, 80, true);
+        timerAttachInterrupt(ustd_bam_timer, ustd_bam_isr, true);
+        timerAlarmWrite(ustd_bam_timer, ustd_bam_ticks[0], true);
+        timerAlarmEnable(ustd_bam_timer);
+        active = true;
+#elif defined(__ESP__)
+        timer1_isr_init();
+        timer1_attachInterrupt(ustd_bam_isr);
+        timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+        timer1_write(ustd_bam_ticks[0]);
+        active = true;
+#endif
+        return active;
+    }
+
+    void end() {
+        /*! Stop the modulation and release the hardware timer */
+        if (!active)
+            return;
+#if defined(__ESP32__)
+        timerAlarmDisable(ustd_bam_timer);
+        timerDetachInterrupt(ustd_bam_timer);
+        timerEnd(ustd_bam_timer);
+        ustd_bam_timer = nullptr;
+#elif defined(__ESP__)
+        timer1_disable();
+        timer1_detachInterrupt();
+#endif
+        ustd_bam_owner = nullptr;
+        active = false;
+    }
+
+    virtual uint8_t channelCount() {
+        return count;
+    }
+
+    virtual bool isDimmable() {
+        return true;
+    }
+
+    virtual void setChannel(uint8_t channel, bool on) {
+        setRawLevel(channel, on ? 255 : 0);
+    }
+
+    virtual void setChannelLevel(uint8_t channel, double level) {
+        if (level < 0.0)
+            level = 0.0;
+        if (level > 1.0)
+            level = 1.0;
+        setRawLevel(channel, (uint8_t)(level * 255.0 + 0.5));
+    }
+
+    void setRawLevel(uint8_t channel, uint8_t value) {
+        /*! Set the 8 bit output level of a channel
+        @param channel Channel number as returned by \ref addPort()
+        @param value Output level [0 (LOW) - 255 (HIGH)]
+        */
+        if (channel >= count || levels[channel] == value)
+            return;
+        levels[channel] = value;
+        update();
+    }
+
+  private:
+    void update() {
+        if (ustd_bam_owner != this)
+            return;  // not running: begin() prepares the masks
+        // prevent the interrupt from swapping in the frame we are going to prepare
+        noInterrupts();
+        ustd_bam_frame_pending = false;
+        uint8_t frame = ustd_bam_frame ^ 1;
+        interrupts();
+        for (uint8_t bit = 0; bit < USTD_BAM_BITS; bit++) {
+            uint32_t setMask = 0;
+            for (uint8_t i = 0; i < count; i++) {
+                if (levels[i] & (1 << bit)) {
+                    setMask |= (uint32_t)1 << ports[i];
+                }
+            }
+            ustd_bam_set_mask[frame][bit] = setMask;
+            ustd_bam_clr_mask[frame][bit] = portMask & ~setMask;
+        }
+        ustd_bam_frame_pending = true;
+    }
+};
+
+const char *BitAngleModulator::version = "0.1.0";
+
+}  // namespace ustd
@@ -0,0 +1,363 @@
+// json_writer.h - forward-only JSON writer
+
+#pragma once
+
+#include "ustd_platform.h"
+
+namespace ustd {
+
+#define USTD_JSON_WRITER_MAX_DEPTH (16)
+
+/*! \brief Forward-only JSON Writer
+
+The JsonWriter class emits JSON text directly into a reusable character buffer. Unlike a DOM
+based approach (e.g. `JSONVar`) keys and values are not allocated on the heap: they are escaped
+and appended to the buffer as they are written. The buffer grows on demand and keeps its
+capacity when it is reset, so that generating a series of similar documents (e.g. discovery
+payloads) does not allocate any memory after the first document.
+
+The writer does not validate the structure of the generated document: the caller is
+responsible for calling the `begin...` and `end...` methods in matching order.
+
+## Sample Usage
+
+\code{cpp}
+ustd::JsonWriter json;
+
+json.beginObject();
+json.add("name", "Light \"1\"");
+json.add("bri_scl", 100);
+json.beginObject("dev");
+json.beginArray("ids");
+json.addValue("84f3eb1a2fd8");
+json.endArray();
+json.endObject();
+json.endObject();
+
+// json.c_str() -> {"name":"Light \"1\"","bri_scl":100,"dev":{"ids":["84f3eb1a2fd8"]}}
+\endcode
+*/
+class JsonWriter {
+  private:
+    char *buffer = nullptr;
+    size_t capacity = 0;
+    size_t len = 0;
+    size_t initialCapacity;
+    uint8_t depth = 0;
+    uint16_t commaMask = 0;
+    bool overflow = false;
+
+  public:
+    JsonWriter(size_t initialCapacity = 256) : initialCapacity(initialCapacity) {
+        /*! Instantiate a JSON writer
+
+        The buffer is allocated on first use.
+
+        @param initialCapacity Initial size of the output buffer in bytes
+        */
+    }
+
+    ~JsonWriter() {
+        if (buffer) {
+            free(buffer);
+        }
+    }
+
+    void reset() {
+        /*! Discard the current document and start a new one. The buffer is kept. */
+        len = 0;
+        depth = 0;
+        commaMask = 0;
+        overflow = false;
+        if (buffer) {
+            *buffer = 0;
+        }
+    }
+
+    const char *c_str() {
+        /*! Get the generated JSON text
+        @return Zero terminated JSON text or an empty string, if memory was exhausted
+        */
+        return (buffer && !overflow) ? buffer : "";
+    }
+
+    size_t length() {
+        /*! Get the length of the generated JSON text
+        @return Length of the JSON text in bytes
+        */
+        return overflow ? 0 : len;
+    }
+
+    size_t getCapacity() {
+        /*! Get the current size of the output buffer
+        @return Size of the output buffer in bytes
+        */
+        return capacity;
+    }
+
+    bool isValid() {
+        /*! Check if the document was written completely
+        @return `false` if memory was exhausted while writing
+        */
+        return !overflow;
+    }
+
+    void beginObject() {
+        /*! Start an anonymous object (the document root or an array element) */
+        separator();
+        open('{');
+    }
+
+    void beginObject(const char *key) {
+        /*! Start a named object
+        @param key Key of the object
+        */
+        writeKey(key);
+        open('{');
+    }
+
+    void endObject() {
+        /*! Close the current object */
+        close('}');
+    }
+
+    void beginArray(const char *key) {
+        /*! Start a named array
+        @param key Key of the array
+        */
+        writeKey(key);
+        open('[');
+    }
+
+    void endArray() {
+        /*! Close the current array */
+        close(']');
+    }
+
+    void add(const char *key, const char *value) {
+        /*! Add a string value
+        @param key Key of the value
+        @param value String value, will be escaped
+        */
+        writeKey(key);
+        append('"');
+        appendEscaped(value);
+        append('"');
+    }
+
+    void add(const char *key, const String &value) {
+        /*! Add a string value
+        @param key Key of the value
+        @param value String value, will be escaped
+        */
+        add(key, value.c_str());
+    }
+
+    void add(const char *key, const char *part1, const char *part2,
+             const char *part3 = nullptr, const char *part4 = nullptr) {
+        /*! Add a string value that is composed from up to four parts
+
+        This avoids the creation of temporary strings when composing topic names.
+
+        @param key Key of the value
+        @param part1 First part of the string value
+        @param part2 Second part of the string value
+        @param part3 Optional third part of the string value
+        @param part4 Optional fourth part of the string value
+        */
+        writeKey(key);
+        append('"');
+        appendEscaped(part1);
+        appendEscaped(part2);
+        appendEscaped(part3);
+        appendEscaped(part4);
+        append('"');
+    }
+
+    void add(const char *key, long value) {
+        /*! Add an integer value
+        @param key Key of the value
+        @param value Integer value
+        */
+        writeKey(key);
+        appendLong(value);
+    }
+
+    void add(const char *key, int value) {
+        /*! Add an integer value
+        @param key Key of the value
+        @param value Integer value
+        */
+        add(key, (long)value);
+    }
+
+    void add(const char *key, bool value) {
+        /*! Add a boolean value
+        @param key Key of the value
+        @param value Boolean value
+        */
+        writeKey(key);
+        append(value ? "true" : "false");
+    }
+
+    void addValue(const char *value) {
+        /*! Add a string element to the current array
+        @param value String value, will be escaped
+        */
+        separator();
+        append('"');
+        appendEscaped(value);
+        append('"');
+    }
+
+    void addValue(const char *value, size_t length) {
+        /*! Add a string element to the current array
+        @param value String value, will be escaped. Does not need to be zero terminated.
+        @param length Number of characters of value to add
+        */
+        separator();
+        append('"');
+        appendEscaped(value, length);
+        append('"');
+    }
+
+    void addValue(long value) {
+        /*! Add an integer element to the current array
+        @param value Integer value
+        */
+        separator();
+        appendLong(value);
+    }
+
+    void addRaw(const char *key, const char *json) {
+        /*! Add a value that is already valid JSON text
+        @param key Key of the value
+        @param json JSON text of the value, inserted unmodified
+        */
+        writeKey(key);
+        append(json);
+    }
+
+  private:
+    bool reserve(size_t extra) {
+        if (overflow) {
+            return false;
+        }
+        if (len + extra + 1 <= capacity) {
+            return true;
+        }
+        size_t newCapacity = capacity ? capacity : initialCapacity;
+        while (newCapacity < len + extra + 1) {
+            newCapacity *= 2;
+        }
+        char *newBuffer = (char *)realloc(buffer, newCapacity);
+        if (!newBuffer) {
+            overflow = true;
+            return false;
+        }
+        buffer = newBuffer;
+        capacity = newCapacity;
+        return true;
+    }
+
+    void append(char c) {
+        if (reserve(1)) {
+            buffer[len++] = c;
+            buffer[len] = 0;
+        }
+    }
+
+    void append(const char *str) {
+        size_t n = strlen(str);
+        if (reserve(n)) {
+            memcpy(buffer + len, str, n + 1);
+            len += n;
+        }
+    }
+
+    void appendEscaped(const char *str, size_t maxLength = (size_t)-1) {
+        if (!str) {
+            return;
+        }
+        static const char hex[] = "0123456789abcdef";
+        for (; *str && maxLength; str++, maxLength--) {
+            unsigned char c = (unsigned char)*str;
+            switch (c) {
+            case '"':
+                append("\\\"");
+                break;
+            case '\\':
+                append("\\\\");
+                break;
+            case '\n':
+                append("\\n");
+                break;
+            case '\r':
+                append("\\r");
+                break;
+            case '\t':
+                append("\\t");
+                break;
+            default:
+                if (c < 0x20) {
+                    char esc[7] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15], 0};
+                    append(esc);
+                } else {
+                    append((char)c);
+                }
+                break;
+            }
+        }
+    }
+
+    void appendLong(long value) {
+        char buf[21];  // 64 bit long: 19 digits, sign and terminator
+        char *p = buf + sizeof(buf) - 1;
+        unsigned long v = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+        *p = 0;
+        do {
+            *--p = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        if (value < 0) {
+            *--p = '-';
+        }
+        append(p);
+    }
+
+    void separator() {
+        if (depth == 0) {
+            return;
+        }
+        uint16_t bit = 1 << (depth - 1);
+        if (commaMask & bit) {
+            append(',');
+        } else {
+            commaMask |= bit;
+        }
+    }
+
+    void writeKey(const char *key) {
+        separator();
+        append('"');
+        appendEscaped(key);
+        append("\":");
+    }
+
+    void open(char c) {
+        append(c);
+        if (depth < USTD_JSON_WRITER_MAX_DEPTH) {
+            ++depth;
+            commaMask &= ~(1 << (depth - 1));
+        }
+    }
+
+    void close(char c) {
+        if (depth) {
+            --depth;
+        }
+        append(c);
+    }
+};
+
+}  // namespace ustd
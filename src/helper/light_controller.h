@@ -5,6 +5,22 @@
 #include "ustd_platform.h"
 #include "mupplet_core.h"
 
+// light modes of the LightController, used in USTD_LIGHT_MODES
+#define USTD_LIGHT_MODE_PASSIVE 0x01  //!< LightController::Passive, always available
+#define USTD_LIGHT_MODE_BLINK 0x02    //!< LightController::Blink
+#define USTD_LIGHT_MODE_WAVE 0x04     //!< LightController::Wave
+#define USTD_LIGHT_MODE_PULSE 0x08    //!< LightController::Pulse
+#define USTD_LIGHT_MODE_PATTERN 0x10  //!< LightController::Pattern
+#define USTD_LIGHT_MODE_ALL 0x1f      //!< all light modes
+
+#ifndef USTD_LIGHT_MODES
+#define USTD_LIGHT_MODES USTD_LIGHT_MODE_ALL  //!< light modes compiled into the LightController
+#endif
+
+#if (USTD_LIGHT_MODES & (USTD_LIGHT_MODE_ALL & ~USTD_LIGHT_MODE_PASSIVE)) == 0
+#define USTD_LIGHT_PASSIVE_ONLY  // no automatic modes: no runtime mode state at all
+#endif
+
 namespace ustd {
 
 /*! \brief The Light Controller Class
@@ -12,6 +28,15 @@ namespace ustd {
  * This class is useful to implement mupplets for things that behave like a light. It
  * supports switching the unit on and off and setting the light intensity.
  * Addionally automatic light effects are supported (see \ref Mode and \ref setMode)
+ *
+ * Applications that do not use all automatic modes can select the modes that are compiled
+ * into the controller by defining `USTD_LIGHT_MODES` before the first mupplet header is
+ * included, e.g. `#define USTD_LIGHT_MODES USTD_LIGHT_MODE_WAVE` or as build flag
+ * `-DUSTD_LIGHT_MODES=USTD_LIGHT_MODE_WAVE`. Code, message parsing and state of the other
+ * modes are removed, \ref setMode ignores modes that are not compiled in. Mode `Passive` is
+ * always available; if it is the only mode, the controller has no runtime mode state and
+ * \ref loop is empty. Otherwise \ref loop still dispatches on the mode at runtime, the
+ * dispatch only contains the compiled-in modes.
  */
 class LightController {
   public:
@@ -48,21 +73,37 @@ class LightController {
 
   private:
     // controller state
+#ifdef USTD_LIGHT_PASSIVE_ONLY
+    static const Mode mode = Passive;
+#else
     Mode mode;
+#endif
     bool state;
     double brightlevel;
     // configuration
     T_CONTROL controller;
+#ifndef USTD_LIGHT_PASSIVE_ONLY
     unsigned long interval = 1000;
     double phase = 0.0;
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_WAVE
     double minWaveBrightness = 0.0;
     double maxWaveBrightness = 1.0;
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PATTERN
     String pattern = "";
+#endif
     // runtime
+#ifndef USTD_LIGHT_PASSIVE_ONLY
     unsigned long uPhase = 0;
     unsigned long oPeriod = 0;
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PULSE
     unsigned long startPulse = 0;
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PATTERN
     unsigned int patternPointer = 0;
+#endif
 
   public:
     LightController() {
@@ -80,19 +121,40 @@ class LightController {
          * @param initialState Initial logical state of the light.
          */
         this->controller = controller;
-        mode = Passive;
+        changeMode(Passive);
         state = !initialState;
         set(initialState);
     }
 
+    void begin(T_CONTROL controller, bool initialState, double initialLevel) {
+        /*! Initiate operation with a given brightness level
+         *
+         * Used to restore a previous state: the hardware is set only once, directly to the
+         * given state and brightness level.
+         *
+         * @param controller The controller function that controls the hardware and publishes state
+         *                   messages.
+         * @param initialState Initial logical state of the light.
+         * @param initialLevel Initial brightness level [0.0 (off) - 1.0 (on)], ignored if the
+         *                     initial state is off.
+         */
+        this->controller = controller;
+        changeMode(Passive);
+        state = initialState && initialLevel > 0.0;
+        brightlevel = state ? (initialLevel > 1.0 ? 1.0 : initialLevel) : 0.0;
+        controller(state, brightlevel, true, true);
+    }
+
     void loop() {
         /*! The loop method
          * This function **must** be called in the loop method of the mupplet. In order
          * to get smoth effects, this function should be called every 50ms.
          */
+#ifndef USTD_LIGHT_PASSIVE_ONLY
         if (mode == Mode::Passive)
             return;
         unsigned long period = (millis() + uPhase) % (2 * interval);
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PULSE
         if (mode == Mode::Pulse) {
             if (millis() - startPulse < interval) {
                 set(true, true);
@@ -101,6 +163,8 @@ class LightController {
                 setMode(Mode::Passive);
             }
         }
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_BLINK
         if (mode == Mode::Blink) {
             if (period < oPeriod) {
                 set(false, true);
@@ -110,6 +174,8 @@ class LightController {
                 }
             }
         }
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_WAVE
         if (mode == Mode::Wave) {
             unsigned long period = (millis() + uPhase) % (2 * interval);
             double br = 0.0;
@@ -121,6 +187,8 @@ class LightController {
             br = br * (maxWaveBrightness - minWaveBrightness) + minWaveBrightness;
             brightness(br, true);
         }
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PATTERN
         if (mode == Mode::Pattern) {
             if (period < oPeriod) {
                 if (patternPointer < pattern.length()) {
@@ -147,10 +215,12 @@ class LightController {
                 }
             }
         }
+#endif
         oPeriod = period;
+#endif
     }
 
-    bool commandParser(String command, String args) {
+    bool commandParser(const String &command, const String &args) {
         /*! A command parser method for the light
 
         This function acceps **commands** and their optional arguments. Usually commands in
@@ -159,7 +229,8 @@ class LightController {
         subscriptions would be:
 
         \code{.cpp}
-        pSched->subscribe(tID, name + "/light/#", [this](String topic, String msg, String orig) {
+        pSched->subscribe(tID, name + "/light/#", [this](const String &topic, const String &msg,
+                                                         const String &orig) {
             this->light.commandParser(topic.substring(name.length() + 7), msg);
         });
         \endcode
@@ -168,17 +239,18 @@ class LightController {
         implementation would be like:
 
         \code{.cpp}
-        pSched->subscribe(tID, name + "/light/#", [this](String topic, String msg, String orig) {
-            topic = topic.substring(name.length() + 7);
+        pSched->subscribe(tID, name + "/light/#", [this](const String &topic, const String &msg,
+                                                         const String &orig) {
+            String command = topic.substring(name.length() + 7);
 
-            if (this->light.commandParser(topic, msg)) {
+            if (this->light.commandParser(command, msg)) {
                 // command was processed in light controller
                 return;
             }
 
-            if (topic == "mycommand") {
+            if (command == "mycommand") {
                 // do my stuff...
-            } else if (topic == "myothercommand") {
+            } else if (command == "myothercommand") {
                 // do my other stuff
             }
         });
@@ -187,7 +259,8 @@ class LightController {
         The following commands are supported:
 
         * `set` - set the light on/off or to a specific intensity
-        * `mode/set` - change the mode - see \ref setMode for details
+        * `mode/set` - change the mode - see \ref setMode for details, only the modes that are
+          compiled in (see `USTD_LIGHT_MODES`) are accepted
         * `unitbrightness/get` - notify the current status
 
         @param command The command to parse
@@ -200,7 +273,7 @@ class LightController {
             return true;
         }
         if (command == "mode/set") {
-#if USTD_FEATURE_MEMORY < USTD_FEATURE_MEM_8K
+#if USTD_FEATURE_MEMORY < USTD_FEATURE_MEM_8K || !(USTD_LIGHT_MODES & USTD_LIGHT_MODE_PATTERN)
             char msgbuf[20];
             memset(msgbuf, 0, 20);
             strncpy(msgbuf, args.c_str(), 19);
@@ -226,26 +299,37 @@ class LightController {
                     }
                 }
             }
+#ifndef USTD_LIGHT_PASSIVE_ONLY
             int t = 1000;
+#endif
+#if USTD_LIGHT_MODES & (USTD_LIGHT_MODE_BLINK | USTD_LIGHT_MODE_WAVE | USTD_LIGHT_MODE_PATTERN)
             double phs = 0.0;
+#endif
             if (!strcmp(msgbuf, "passive")) {
                 setMode(Mode::Passive);
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PULSE
             } else if (!strcmp(msgbuf, "pulse")) {
                 if (p)
                     t = atoi(p);
                 setMode(Mode::Pulse, t);
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_BLINK
             } else if (!strcmp(msgbuf, "blink")) {
                 if (p)
                     t = atoi(p);
                 if (p2)
                     phs = atof(p2);
                 setMode(Mode::Blink, t, phs);
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_WAVE
             } else if (!strcmp(msgbuf, "wave")) {
                 if (p)
                     t = atoi(p);
                 if (p2)
                     phs = atof(p2);
                 setMode(Mode::Wave, t, phs);
+#endif
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PATTERN
             } else if (!strcmp(msgbuf, "pattern")) {
                 if (p && strlen(p) > 0) {
                     if (p2)
@@ -254,6 +338,7 @@ class LightController {
                         phs = atof(p3);
                     setMode(Mode::Pattern, t, phs, p);
                 }
+#endif
             }
             return true;
         }
@@ -301,8 +386,13 @@ class LightController {
                        the time for each pattern step. Example "++-r" with intervall_ms=100
                        lights the led for 200ms on, 100ms off and repeats. "1---------r" makes
                        a faint 100ms flash every second. "0135797531r" simulates a wave.
+
+        Modes that are not compiled in (see `USTD_LIGHT_MODES`) are ignored.
         */
-        this->mode = mode;
+        if (!isModeAvailable(mode))
+            return;
+        changeMode(mode);
+#ifndef USTD_LIGHT_PASSIVE_ONLY
         if (mode == Mode::Passive)
             return;
         phase = phase_unit;
@@ -315,13 +405,69 @@ class LightController {
             interval = 100;
         if (interval > 100000)
             interval = 100000;
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PULSE
         startPulse = millis();
+#endif
         uPhase = (unsigned long)(2.0 * (double)interval * phase);
         oPeriod = (millis() + uPhase) % interval;
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_PATTERN
         if (mode == Mode::Pattern) {
             this->pattern = pattern;
             patternPointer = 0;
         }
+#endif
+#endif
+    }
+
+    static constexpr bool isModeAvailable(Mode mode) {
+        /*! Check if a light \ref Mode is compiled in (see `USTD_LIGHT_MODES`)
+        @param mode Light \ref Mode
+        @return `true` if the mode is available
+        */
+        return ((USTD_LIGHT_MODES | USTD_LIGHT_MODE_PASSIVE) >> mode) & 1;
+    }
+
+    Mode getMode() {
+        /*! Get the current light \ref Mode
+        @return Current light mode
+        */
+        return mode;
+    }
+
+    bool getState() {
+        /*! Get the current logical state
+        @return `true` if the light is on
+        */
+        return state;
+    }
+
+    double getBrightness() {
+        /*! Get the current brightness level
+        @return Brightness level [0.0 (off) - 1.0 (on)]
+        */
+        return brightlevel;
+    }
+
+    unsigned long getInterval() {
+        /*! Get the interval of the current light mode
+        @return Duration of blink, pulse or pattern step in ms
+        */
+#ifdef USTD_LIGHT_PASSIVE_ONLY
+        return 1000;
+#else
+        return interval;
+#endif
+    }
+
+    double getPhase() {
+        /*! Get the phase of the current light mode
+        @return Phase difference [0.0-1.0]
+        */
+#ifdef USTD_LIGHT_PASSIVE_ONLY
+        return 0.0;
+#else
+        return phase;
+#endif
     }
 
     void setMinMaxWaveBrightness(double minBrightness, double maxBrightness) {
@@ -330,6 +476,7 @@ class LightController {
         @param minBrightness Minimum brightness 0-1.0
         @param maxBrightness Maximum brightness 0-1.0
         */
+#if USTD_LIGHT_MODES & USTD_LIGHT_MODE_WAVE
         if (minBrightness < 0.0 || minBrightness > 1.0)
             minBrightness = 0.0;
         if (maxBrightness < 0.0 || maxBrightness > 1.0)
@@ -340,6 +487,7 @@ class LightController {
         }
         minWaveBrightness = minBrightness;
         maxWaveBrightness = maxBrightness;
+#endif
     }
 
     void forceState(bool state, double brightlevel) {
@@ -376,11 +524,17 @@ class LightController {
     }
 
   private:
+    void changeMode(Mode newMode) {
+#ifndef USTD_LIGHT_PASSIVE_ONLY
+        mode = newMode;
+#endif
+    }
+
     void set(bool _state, bool _automatic) {
         if (_state == state)
             return;
         if (!_automatic)
-            mode = Mode::Passive;
+            changeMode(Mode::Passive);
         // if we want to preserve the brightness level, we need to change this
         brightlevel = _state ? 1.0 : 0.0;
         state = _state;
@@ -395,7 +549,7 @@ class LightController {
         if (brightlevel == _brightlevel)
             return;
         if (!_automatic)
-            mode = Mode::Passive;
+            changeMode(Mode::Passive);
         brightlevel = _brightlevel;
         state = _brightlevel > 0.0;
         controller(state, brightlevel, true, !_automatic);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <math.h>
+#include <time.h>
 
 namespace ustd {
 
@@ -12,14 +13,74 @@ const double C_C = 299792458.0;                   //!< speed of light, m/s
 const double C_CAUD = C_C * 60 * 60 * 24 / C_AU;  //!< AUs per day, approx 173
 const double C_MJD = 2400000.5;                   //!< MJD = JD - C_MJD
 
+const double C_ZENITH_OFFICIAL = 90.0 + 50.0 / 60.0;  //!< sun zenith, sunrise and sunset
+const double C_ZENITH_CIVIL = 96.0;                   //!< sun zenith, civil twilight
+const double C_ZENITH_NAUTICAL = 102.0;               //!< sun zenith, nautical twilight
+const double C_ZENITH_ASTRONOMICAL = 108.0;           //!< sun zenith, astronomical twilight
+
 /*! \brief mupplet helper for some astronomical calculations: sunrise and sunset
 
-Warning: WIP!
+The static methods perform the calculations for arbitrary dates and locations.
+
+An Astro instance calculates the times of sunrise, sunset, solar noon and civil and nautical
+twilight for its location once per day and caches them, so that queries like \ref isDaytime()
+or \ref minutesUntilSunset() can be answered without any trigonometry, even if they are
+polled on every scheduler tick. All instance methods take the current time as unix timestamp
+(UTC, e.g. `time(nullptr)`); the local time is derived with the `utcOffset` of the instance.
+
+The sun times are calculated with \ref calculateSunEvent() in double precision. On MCUs without
+double precision floating point hardware, define `USTD_ASTRO_SINGLE_PRECISION` to use
+\ref calculateSunEventFloat() or `USTD_ASTRO_FIXED_POINT` to use \ref calculateSunEventFixed()
+instead (before including this header). Both deviate from the double precision results by less
+than two seconds, which is well below the resolution of one minute of the cached sun times.
+
+\code{cpp}
+ustd::Astro astro(48.1374, 11.5755, 3600);  // Munich, CET
+
+void appLoop() {
+    time_t now = time(nullptr);
+    if (!astro.isDaytime(now, ustd::Astro::Civil)) {
+        // it's dark: switch on the lights
+    }
+    if (astro.minutesUntilSunset(now) == 15) {
+        // 15 minutes before sunset
+    }
+}
+\endcode
 */
 class Astro {
   public:
     double lat, lon, utcOffset;
 
+    /*! Twilight included in the daytime by \ref isDaytime() */
+    enum Twilight {
+        None,    /*!< day is from sunrise to sunset */
+        Civil,   /*!< day is from the begin of the civil dawn to the end of the civil dusk */
+        Nautical /*!< day is from the begin of the nautical dawn to the end of the nautical dusk */
+    };
+
+    /*! Times of the sun events of one day in minutes since local midnight [0..1439]
+
+    Events that do not occur on this day (e.g. during polar day or night) are -1.
+    */
+    typedef struct {
+        int16_t nauticalDawn; /*!< begin of nautical twilight (sun at -12°) */
+        int16_t civilDawn;    /*!< begin of civil twilight (sun at -6°) */
+        int16_t sunrise;      /*!< sunrise */
+        int16_t noon;         /*!< solar noon */
+        int16_t sunset;       /*!< sunset */
+        int16_t civilDusk;    /*!< end of civil twilight (sun at -6°) */
+        int16_t nauticalDusk; /*!< end of nautical twilight (sun at -12°) */
+    } SunTimes;
+
+    static const int NoEvent = -32768;  //!< returned by minutesUntil...() if there is no event
+
+  private:
+    long cachedDay = -0x7fffffffL;  // no sun times calculated yet
+    SunTimes sunTimes;
+    int8_t polarState[3];  // per Twilight: 1 = always day, -1 = always night, 0 = normal day
+
+  public:
 #ifdef USTD_FEATURE_FILESYSTEM
     Astro() {
         /*! This will at some point contain initialization from filesystem */
@@ -35,6 +96,171 @@ class Astro {
         */
     }
 
+    void setLocation(double _lat, double _lon, double _utcOffset) {
+        /*! Change the location or the time zone
+
+        The cached sun times are recalculated on the next query.
+
+        @param _lat lattitude in degree
+        @param _lon longitude in degree
+        @param _utcOffset UTC time offset in seconds
+        */
+        lat = _lat;
+        lon = _lon;
+        utcOffset = _utcOffset;
+        cachedDay = -0x7fffffffL;
+    }
+
+    const SunTimes &getSunTimes(time_t now) {
+        /*! Get the times of the sun events of the current day
+
+        The times are calculated once per day (local time) and cached.
+
+        @param now current time as unix timestamp (UTC)
+        @return sun times of the local day of `now`
+        */
+        time_t local = now + (time_t)utcOffset;
+        long day = (long)(local / 86400);
+        if (day != cachedDay) {
+            calculateDay(day);
+        }
+        return sunTimes;
+    }
+
+    int16_t minuteOfDay(time_t now) {
+        /*! Get the local time in minutes since midnight
+        @param now current time as unix timestamp (UTC)
+        @return local time in minutes since midnight [0..1439]
+        */
+        time_t local = now + (time_t)utcOffset;
+        return (int16_t)((local % 86400) / 60);
+    }
+
+    bool isDaytime(time_t now, Twilight twilight = None) {
+        /*! Check if it is day at the location
+
+        @param now current time as unix timestamp (UTC)
+        @param twilight \ref Twilight that is counted as daytime (default: none, day is from
+                        sunrise to sunset)
+        @return `true` if it is day
+        */
+        const SunTimes &st = getSunTimes(now);
+        int16_t start = twilight == Civil      ? st.civilDawn
+                        : twilight == Nautical ? st.nauticalDawn
+                                               : st.sunrise;
+        int16_t end = twilight == Civil      ? st.civilDusk
+                      : twilight == Nautical ? st.nauticalDusk
+                                             : st.sunset;
+        if (start < 0 || end < 0) {
+            return polarState[twilight] > 0;
+        }
+        int16_t m = minuteOfDay(now);
+        if (start <= end) {
+            return m >= start && m < end;
+        }
+        // the day extends over local midnight
+        return m >= start || m < end;
+    }
+
+    int minutesUntilSunrise(time_t now) {
+        /*! Get the minutes until sunrise of the current day
+        @param now current time as unix timestamp (UTC)
+        @return minutes until sunrise, negative if the sun has already risen today or
+                \ref NoEvent if the sun does not rise today
+        */
+        return minutesUntil(getSunTimes(now).sunrise, now);
+    }
+
+    int minutesUntilSunset(time_t now) {
+        /*! Get the minutes until sunset of the current day
+        @param now current time as unix timestamp (UTC)
+        @return minutes until sunset, negative if the sun has already set today or
+                \ref NoEvent if the sun does not set today
+        */
+        return minutesUntil(getSunTimes(now).sunset, now);
+    }
+
+    int minutesUntilNoon(time_t now) {
+        /*! Get the minutes until solar noon of the current day
+        @param now current time as unix timestamp (UTC)
+        @return minutes until solar noon, negative if noon has already passed today
+        */
+        return minutesUntil(getSunTimes(now).noon, now);
+    }
+
+  private:
+    int minutesUntil(int16_t event, time_t now) {
+        if (event < 0) {
+            return NoEvent;
+        }
+        return (int)event - (int)minuteOfDay(now);
+    }
+
+    int16_t toLocalMinutes(double ut) {
+        long m = lround(ut * 60.0 + utcOffset / 60.0) % 1440;
+        return (int16_t)(m < 0 ? m + 1440 : m);
+    }
+
+    static int16_t midpoint(int16_t start, int16_t end) {
+        if (end < start) {
+            end += 1440;
+        }
+        return (int16_t)(((start + end) / 2) % 1440);
+    }
+
+    int8_t sunEvent(int y, int m, int d, double zenith, bool bRising, double *pUT) {
+#if defined(USTD_ASTRO_FIXED_POINT)
+        int32_t ut;
+        int8_t ret = calculateSunEventFixed(y, m, d, toFixed(lat), toFixed(lon), toFixed(zenith),
+                                            bRising, &ut);
+        *pUT = ut / 3600.0;
+        return ret;
+#elif defined(USTD_ASTRO_SINGLE_PRECISION)
+        float ut;
+        int8_t ret = calculateSunEventFloat(y, m, d, lat, lon, zenith, bRising, &ut);
+        *pUT = ut;
+        return ret;
+#else
+        return calculateSunEvent(y, m, d, lat, lon, zenith, bRising, pUT);
+#endif
+    }
+
+    void calculateDay(long day) {
+        // civil date from days since 1970-01-01 (H. Hinnant's algorithm)
+        long z = day + 719468;
+        long era = (z >= 0 ? z : z - 146096) / 146097;
+        long doe = z - era * 146097;
+        long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        long mp = (5 * doy + 2) / 153;
+        int d = (int)(doy - (153 * mp + 2) / 5 + 1);
+        int m = (int)(mp < 10 ? mp + 3 : mp - 9);
+        int y = (int)(yoe + era * 400 + (m <= 2 ? 1 : 0));
+
+        const double zenith[3] = {C_ZENITH_OFFICIAL, C_ZENITH_CIVIL, C_ZENITH_NAUTICAL};
+        int16_t *dawn[3] = {&sunTimes.sunrise, &sunTimes.civilDawn, &sunTimes.nauticalDawn};
+        int16_t *dusk[3] = {&sunTimes.sunset, &sunTimes.civilDusk, &sunTimes.nauticalDusk};
+        sunTimes.noon = -1;
+        for (uint8_t i = 0; i < 3; i++) {
+            double ut;
+            int8_t rising = sunEvent(y, m, d, zenith[i], true, &ut);
+            *dawn[i] = rising ? -1 : toLocalMinutes(ut);
+            int8_t setting = sunEvent(y, m, d, zenith[i], false, &ut);
+            *dusk[i] = setting ? -1 : toLocalMinutes(ut);
+            polarState[i] = rising ? rising : setting;
+            if (sunTimes.noon < 0 && *dawn[i] >= 0 && *dusk[i] >= 0) {
+                sunTimes.noon = midpoint(*dawn[i], *dusk[i]);
+            }
+        }
+        if (sunTimes.noon < 0) {
+            // local mean noon
+            sunTimes.noon = toLocalMinutes(12.0 - lon / 15.0);
+        }
+        cachedDay = day;
+    }
+
+  public:
+
     static long julianDayNumber(int year, uint8_t month, uint8_t day) {
         /*! Calculate the julian day number
 
@@ -129,19 +355,79 @@ class Astro {
         return JD;
     }
 
-    static bool calculateSunRiseSet(int year, int month, int day, double lat, double lon,
-                                    int localOffset, int daylightSavings, bool bRising,
-                                    double *pSunTime) {
-        /*!
-        // Source: http://edwilliams.org/sunrise_sunset_algorithm.htm
+    static float modifiedJulianDateFloat(int year, uint8_t month, uint8_t day, uint8_t hour,
+                                         uint8_t min, float sec) {
+        /*! fractional modified julian date in single precision
 
-        localOffset will be <0 for western hemisphere and >0 for eastern hemisphere
-        daylightSavings should be 1 if it is in effect during the summer otherwise it should be 0
+        Single precision variant of \ref modifiedJulianDate() for MCUs without double precision
+        floating point hardware. With a 24 bit mantissa, the result has a resolution of
+        1/256 day for the years 1948 - 2038 (MJD 32768 - 65535) and 1/128 day after that. The
+        error against \ref modifiedJulianDate() is below 0.002 days (3 minutes) for the years
+        1948 - 2038. Use \ref julianDateJ2000Fixed() if a higher resolution is required.
 
-        Warning: WIP! Isn't integrated with class functions yet...
+        @param year 4-digit year, e.g. 2021
+        @param month [1-12]
+        @param day [1-31]
+        @param hour [0-23]
+        @param min [0-59]
+        @param sec [0.0-59.99999..]
+        @return fractional modified julian date
+        */
+        long MJD = julianDayNumber(year, month, day) - 2400001L;
+        return (float)MJD + ((float)hour + (float)min / 60.0f + sec / 3600.0f) / 24.0f;
+    }
+
+    static int32_t julianDateJ2000Fixed(int year, uint8_t month, uint8_t day, uint8_t hour,
+                                        uint8_t min, uint8_t sec) {
+        /*! fractional julian date relative to J2000.0 in fixed point format
+
+        Fixed point variant of the julian date that uses only integer arithmetic: the result
+        is the number of days since J2000.0 (2000-01-01 12:00 UT, JD 2451545.0) as signed
+        16.16 fixed point number, i.e. `(julianDate() - 2451545.0) * 65536`. The resolution is
+        1/65536 day (1.3 seconds), the error against \ref julianDate() is at most half of that.
+        A 16.16 number covers ±32768 days around J2000.0: the result is only valid from
+        1910-04-15 12:00 UT to 2089-09-18 11:59:59 UT, outside this range it overflows.
+
+        @param year 4-digit year, e.g. 2021 [1910-2089, see the exact range above]
+        @param month [1-12]
+        @param day [1-31]
+        @param hour [0-23]
+        @param min [0-59]
+        @param sec [0-59]
+        @return days since J2000.0 as 16.16 fixed point number
+        */
+        int32_t days = (int32_t)(julianDayNumber(year, month, day) - 2451545L);
+        // 65536 / 86400 = 512 / 675, 12:00 is exactly 32768
+        uint32_t secs = (uint32_t)hour * 3600UL + (uint32_t)min * 60UL + sec;
+        int32_t frac = (int32_t)((secs * 512UL + 337UL) / 675UL) - 32768L;
+        return (int32_t)((uint32_t)days << 16) + frac;
+    }
+
+    static int8_t calculateSunEvent(int year, int month, int day, double lat, double lon,
+                                    double zenith, bool bRising, double *pUT) {
+        /*! Calculate the time at which the sun crosses a given zenith angle
+
+        Source: http://edwilliams.org/sunrise_sunset_algorithm.htm
+
+        The zenith angle defines the event: \ref C_ZENITH_OFFICIAL (90°50') for sunrise and
+        sunset, \ref C_ZENITH_CIVIL (96°), \ref C_ZENITH_NAUTICAL (102°) and
+        \ref C_ZENITH_ASTRONOMICAL (108°) for the beginning and the end of the respective
+        twilight.
+
+        @param year 4-digit year, e.g. 2021
+        @param month [1-12]
+        @param day [1-31]
+        @param lat lattitude in degree
+        @param lon longitude in degree (negative for western hemisphere)
+        @param zenith zenith angle of the sun in degree
+        @param bRising `true` for the morning event (sunrise, dawn), `false` for the evening event
+                       (sunset, dusk)
+        @param pUT pointer to a variable that receives the time of the event in hours UTC
+                   [0.0 .. 24.0[ or -1.0 if the event does not occur on this day
+        @return 0: the event occurs, -1: the sun stays below the zenith angle during the whole day,
+                1: the sun stays above the zenith angle during the whole day
         */
         // 1. first calculate the day of the year
-        const double ZENITH = 90.0 + 50.0 / 60.0;
         double N1 = floor(275.0 * month / 9.0);
         double N2 = floor((month + 9.0) / 12.0);
         double N3 = (1.0 + floor((year - 4 * floor(year / 4.0) + 2.0) / 3.0));
@@ -178,21 +464,15 @@ class Astro {
         double cosDec = cos(asin(sinDec));
 
         // 7a. calculate the Sun's local hour angle
-        // double cosH = (sin(C_D2R * ZENITH) - (sinDec * sin(C_D2R * lat))) /
-        //              (cosDec * cos(C_D2R * lat));
         double cosH =
-            (cos(C_D2R * ZENITH) - (sinDec * sin(lat * C_D2R))) / (cosDec * cos(C_D2R * lat));
-
-        if (bRising) {
-            if (cosH > 1.0) {  // the sun never rises on this location (on the specified date)
-                *pSunTime = -1.0;
-                return false;
-            }
-        } else {
-            if (cosH < -1.0) {  // the sun never sets on this location (on the specified date)
-                *pSunTime = -1.0;
-                return false;
-            }
+            (cos(C_D2R * zenith) - (sinDec * sin(lat * C_D2R))) / (cosDec * cos(C_D2R * lat));
+        if (cosH > 1.0) {  // the sun never rises above the zenith angle on this day
+            *pUT = -1.0;
+            return -1;
+        }
+        if (cosH < -1.0) {  // the sun never sets below the zenith angle on this day
+            *pUT = -1.0;
+            return 1;
         }
 
         // 7b. finish calculating H and convert into hours
@@ -208,9 +488,197 @@ class Astro {
 
         // 9. adjust back to UTC
         double UT = fmod(T - lonHour, 24.0);
+        *pUT = UT < 0.0 ? UT + 24.0 : UT;
+        return 0;
+    }
+
+    static int8_t calculateSunEventFloat(int year, int month, int day, float lat, float lon,
+                                         float zenith, bool bRising, float *pUT) {
+        /*! Calculate the time at which the sun crosses a given zenith angle in single precision
+
+        Single precision variant of \ref calculateSunEvent() for MCUs without double precision
+        floating point hardware (e.g. ESP32: single precision FPU only; ESP8266: software
+        floating point, single precision is considerably faster than double). The error against
+        \ref calculateSunEvent() is below 1 second for latitudes up to ±80° and below 2 seconds
+        up to ±85° (years 2000 - 2050, all longitudes, official, civil and nautical zenith).
+
+        @param year 4-digit year, e.g. 2021
+        @param month [1-12]
+        @param day [1-31]
+        @param lat lattitude in degree
+        @param lon longitude in degree (negative for western hemisphere)
+        @param zenith zenith angle of the sun in degree
+        @param bRising `true` for the morning event (sunrise, dawn), `false` for the evening event
+                       (sunset, dusk)
+        @param pUT pointer to a variable that receives the time of the event in hours UTC
+                   [0.0 .. 24.0[ or -1.0 if the event does not occur on this day
+        @return 0: the event occurs, -1: the sun stays below the zenith angle during the whole day,
+                1: the sun stays above the zenith angle during the whole day
+        */
+        const float D2R = (float)C_D2R;
+        const float R2D = (float)C_R2D;
+        // day of the year and approximate time
+        int N = dayOfYear(year, month, day);
+        float lonHour = lon / 15.0f;
+        float t = (float)N + ((bRising ? 6.0f : 18.0f) - lonHour) / 24.0f;
+
+        // mean anomaly and true longitude
+        float M = (0.9856f * t) - 3.289f;
+        float L = fmodf(M + (1.916f * sinf(D2R * M)) + (0.020f * sinf(2.0f * D2R * M)) + 282.634f,
+                        360.0f);
+
+        // right ascension in the same quadrant as L, in hours
+        float RA = R2D * atan2f(0.91764f * sinf(D2R * L), cosf(D2R * L));
+        RA = (RA < 0.0f ? RA + 360.0f : RA) / 15.0f;
+
+        // declination and local hour angle
+        float sinDec = 0.39782f * sinf(D2R * L);
+        float cosDec = sqrtf(1.0f - sinDec * sinDec);
+        float num = cosf(D2R * zenith) - (sinDec * sinf(D2R * lat));
+        float den = cosDec * cosf(D2R * lat);
+        // at the poles, cosf() can return tiny negative values: only the declination matters
+        float cosH = den > 0.0f ? num / den : (num > 0.0f ? 2.0f : -2.0f);
+        if (cosH > 1.0f) {
+            *pUT = -1.0f;
+            return -1;
+        }
+        if (cosH < -1.0f) {
+            *pUT = -1.0f;
+            return 1;
+        }
+        float H = R2D * acosf(cosH);
+        if (bRising) {
+            H = 360.0f - H;
+        }
+
+        // local mean time of the event, adjusted to UTC
+        float T = H / 15.0f + RA - (0.06571f * t) - 6.622f;
+        float UT = fmodf(T - lonHour, 24.0f);
+        *pUT = UT < 0.0f ? UT + 24.0f : UT;
+        return 0;
+    }
+
+    static int8_t calculateSunEventFixed(int year, int month, int day, int32_t lat, int32_t lon,
+                                         int32_t zenith, bool bRising, int32_t *pUT) {
+        /*! Calculate the time at which the sun crosses a given zenith angle in fixed point
+
+        Fixed point variant of \ref calculateSunEvent() that uses only integer arithmetic (32 bit
+        fixed point numbers, 64 bit intermediate products and CORDIC trigonometry), suitable
+        for MCUs without any floating point hardware. Angles are signed 16.16 fixed point
+        numbers in degree, e.g. `(int32_t)(48.1374 * 65536)`, see \ref toFixed().
+
+        The error against \ref calculateSunEvent() is below 1 second (mostly the rounding to full
+        seconds) for latitudes up to ±85° (years 2000 - 2050, all longitudes, official, civil and
+        nautical zenith). The calculation takes about 5 times as long as the double precision
+        variant on a 64 bit CPU with FPU, but uses no floating point operations at all.
+
+        @param year 4-digit year, e.g. 2021
+        @param month [1-12]
+        @param day [1-31]
+        @param lat lattitude in degree, 16.16 fixed point
+        @param lon longitude in degree (negative for western hemisphere), 16.16 fixed point
+        @param zenith zenith angle of the sun in degree, 16.16 fixed point
+        @param bRising `true` for the morning event (sunrise, dawn), `false` for the evening event
+                       (sunset, dusk)
+        @param pUT pointer to a variable that receives the time of the event in seconds UTC
+                   [0 .. 86399] or -1 if the event does not occur on this day
+        @return 0: the event occurs, -1: the sun stays below the zenith angle during the whole day,
+                1: the sun stays above the zenith angle during the whole day
+        */
+        const int32_t FULL = 360L << 16;
+        const int32_t ONE = 1L << 29;  // trigonometric values are 2.29 fixed point numbers
+        // day of the year and approximate time in days, the longitude correction is
+        // (6h - lon / 15) / 24h = (90° - lon) / 360°
+        int32_t t = ((int32_t)dayOfYear(year, month, day) << 16) +
+                    (((bRising ? 90L : 270L) << 16) - lon) / 360;
+
+        // mean anomaly and true longitude
+        int32_t M = fxMul(t, toFixed(0.9856, 24), 24) - toFixed(3.289);
+        int32_t L = M + fxMul(toFixed(1.916), fxSin(M), 29) +
+                    fxMul(toFixed(0.020), fxSin(2 * M), 29) + toFixed(282.634);
+        L = fxNormalize(L);
+
+        // right ascension in the same quadrant as L
+        int32_t sinL = fxSin(L);
+        int32_t RA = fxAtan2(fxMul(toFixed(0.91764, 29), sinL, 29), fxSin(L + (90L << 16)));
+
+        // declination and local hour angle
+        int32_t sinDec = fxMul(toFixed(0.39782, 29), sinL, 29);
+        int32_t cosDec = fxSqrt((uint64_t)(ONE - fxMul(sinDec, sinDec, 29)) << 29);
+        int32_t num = fxSin((90L << 16) - zenith) - fxMul(sinDec, fxSin(lat), 29);
+        int32_t den = fxMul(cosDec, fxSin((90L << 16) - lat), 29);
+        // cos(H) as 2.30 fixed point: close to ±1, acos() is very sensitive to rounding errors
+        int64_t cosH;
+        if (den > 0) {
+            cosH = ((int64_t)num << 30) / den;
+        } else {  // at the poles: only the declination matters
+            cosH = num > 0 ? (1LL << 30) + 1 : -(1LL << 30) - 1;
+        }
+        if (cosH > (1LL << 30)) {
+            *pUT = -1;
+            return -1;
+        }
+        if (cosH < -(1LL << 30)) {
+            *pUT = -1;
+            return 1;
+        }
+        // sin(H) = sqrt((1 - cos(H)) * (1 + cos(H)))
+        uint64_t sin2H = (uint64_t)((1LL << 30) - cosH) * (uint64_t)((1LL << 30) + cosH);
+        int32_t H = fxAtan2(fxSqrt(sin2H >> 2), (int32_t)(cosH >> 1));
+        if (bRising) {
+            H = FULL - H;
+        }
 
-        // 10. convert UT value to local time zone of latitude/longitude
-        *pSunTime = UT + localOffset + daylightSavings;
+        // local mean time of the event, adjusted to UTC (1° = 240 seconds)
+        int32_t T = H + RA - fxMul(t, toFixed(0.06571 * 15.0, 24), 24) - toFixed(6.622 * 15.0);
+        T = fxNormalize(T - lon);
+        *pUT = (T * 15 + 2048) >> 12;
+        if (*pUT >= 86400L) {
+            *pUT -= 86400L;
+        }
+        return 0;
+    }
+
+    static constexpr int32_t toFixed(double value, uint8_t fractionBits = 16) {
+        /*! Convert a constant to a fixed point number
+
+        Intended for constants and configuration values: if `value` is a constant expression,
+        the conversion is done at compile time.
+
+        @param value value to convert
+        @param fractionBits number of fractional bits of the fixed point number
+        @return fixed point value, rounded
+        */
+        return (int32_t)(value * (double)(1L << fractionBits) + (value < 0.0 ? -0.5 : 0.5));
+    }
+
+    static bool calculateSunRiseSet(int year, int month, int day, double lat, double lon,
+                                    int localOffset, int daylightSavings, bool bRising,
+                                    double *pSunTime) {
+        /*! Calculate the time of sunrise or sunset
+
+        Source: http://edwilliams.org/sunrise_sunset_algorithm.htm
+
+        See \ref calculateSunEvent() for twilight times and the instance methods (e.g.
+        \ref getSunTimes()) for cached results.
+
+        @param year 4-digit year, e.g. 2021
+        @param month [1-12]
+        @param day [1-31]
+        @param lat lattitude in degree
+        @param lon longitude in degree (negative for western hemisphere)
+        @param localOffset offset of the local time zone in hours, <0 for western hemisphere and
+                           >0 for eastern hemisphere
+        @param daylightSavings 1 if daylight savings time is in effect, otherwise 0
+        @param bRising `true` for sunrise, `false` for sunset
+        @param pSunTime pointer to a variable that receives the local time of the event in hours
+                        or -1.0 if the sun does not rise or set on this day
+        @return `true` if the event occurs
+        */
+        if (calculateSunEvent(year, month, day, lat, lon, C_ZENITH_OFFICIAL, bRising, pSunTime)) {
+            return false;
+        }
+        *pSunTime = fmod(*pSunTime + localOffset + daylightSavings + 24.0, 24.0);
         return true;
     }
 
@@ -289,6 +757,115 @@ class Astro {
         *minute = mn;
         return true;
     }
+
+  private:
+    static int dayOfYear(int year, int month, int day) {
+        int N1 = 275 * month / 9;
+        int N2 = (month + 9) / 12;
+        int N3 = 1 + (year % 4 + 2) / 3;
+        return N1 - (N2 * N3) + day - 30;
+    }
+
+    static int32_t fxMul(int32_t a, int32_t b, uint8_t fractionBits = 16) {
+        return (int32_t)(((int64_t)a * b + (1LL << (fractionBits - 1))) >> fractionBits);
+    }
+
+    static int32_t fxNormalize(int32_t angle) {
+        // [0 .. 360[ degree
+        const int32_t FULL = 360L << 16;
+        angle %= FULL;
+        return angle < 0 ? angle + FULL : angle;
+    }
+
+    static int32_t fxSqrt(uint64_t value) {
+        // bitwise integer square root
+        uint64_t res = 0;
+        uint64_t one = 1ULL << 62;
+        while (one > value) {
+            one >>= 2;
+        }
+        while (one) {
+            if (value >= res + one) {
+                value -= res + one;
+                res = (res >> 1) + one;
+            } else {
+                res >>= 1;
+            }
+            one >>= 2;
+        }
+        return (int32_t)res;
+    }
+
+    static const int32_t *cordicAngles() {
+        // atan(2^-i) in degree, 8.24 fixed point
+        static const int32_t angles[24] = {754974720, 445687602, 235489088, 119537938, 60000934,
+                                            30029717, 15018523, 7509720, 3754917, 1877466, 938734,
+                                            469367, 234684, 117342, 58671, 29335, 14668, 7334, 3667,
+                                            1833, 917, 458, 229, 115};
+        return angles;
+    }
+
+    static int32_t fxSin(int32_t angle) {
+        // sine of an angle in degree (16.16 fixed point) as 2.29 fixed point,
+        // CORDIC in rotation mode
+        const int32_t *atanTable = cordicAngles();
+        angle = fxNormalize(angle);
+        if (angle > (180L << 16)) {
+            angle -= 360L << 16;
+        }
+        bool negate = false;
+        if (angle > (90L << 16)) {
+            angle -= 180L << 16;
+            negate = true;
+        } else if (angle < -(90L << 16)) {
+            angle += 180L << 16;
+            negate = true;
+        }
+        angle <<= 8;
+        int32_t x = 326016437L;  // CORDIC gain 0.607252935 as 2.29 fixed point
+        int32_t y = 0;
+        for (uint8_t i = 0; i < 24; i++) {
+            int32_t dx = y >> i;
+            int32_t dy = x >> i;
+            if (angle >= 0) {
+                x -= dx;
+                y += dy;
+                angle -= atanTable[i];
+            } else {
+                x += dx;
+                y -= dy;
+                angle += atanTable[i];
+            }
+        }
+        return negate ? -y : y;
+    }
+
+    static int32_t fxAtan2(int32_t y, int32_t x) {
+        // angle of the vector (x, y) (2.29 fixed point, |x|, |y| <= 1.0) in degree [0 .. 360[,
+        // 16.16 fixed point, CORDIC in vectoring mode
+        const int32_t *atanTable = cordicAngles();
+        int32_t offset = 0;
+        if (x < 0) {
+            x = -x;
+            y = -y;
+            offset = 180L << 16;
+        }
+        int32_t angle = 0;
+        for (uint8_t i = 0; i < 24; i++) {
+            int32_t dx = y >> i;
+            int32_t dy = x >> i;
+            if (y > 0) {
+                x += dx;
+                y -= dy;
+                angle += atanTable[i];
+            } else {
+                x -= dx;
+                y += dy;
+                angle -= atanTable[i];
+            }
+        }
+        return fxNormalize(offset + ((angle + 128) >> 8));
+    }
 };
 
 }  // namespace ustd
\ No newline at end of file
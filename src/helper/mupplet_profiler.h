@@ -0,0 +1,523 @@
+// mupplet_profiler.h - opt-in runtime profiling of mupplets
+
+#pragma once
+
+#if defined(__USE_MUPPLET_ALLOC_COUNTING__) && !defined(__USE_MUPPLET_HEAP_PROFILING__)
+#define __USE_MUPPLET_HEAP_PROFILING__
+#endif
+#if defined(__USE_MUPPLET_HEAP_PROFILING__) && !defined(__USE_MUPPLET_PROFILING__)
+#define __USE_MUPPLET_PROFILING__
+#endif
+
+#ifdef __USE_MUPPLET_PROFILING__
+
+#include "scheduler.h"
+#include "json_writer.h"
+#include "ustd_array.h"
+#include "helper/alloc_counter.h"
+
+#ifndef USTD_PROFILER_MAX_TOPICS
+#define USTD_PROFILER_MAX_TOPICS (16)  //!< topics per mupplet with own allocation statistics
+#endif
+
+namespace ustd {
+
+inline unsigned long muppletFreeHeap() {
+    /*! Get the free heap memory
+    @return Free heap memory in bytes, 0 on platforms without heap information
+    */
+#if defined(__ESP__)
+    return ESP.getFreeHeap();
+#else
+    return 0;
+#endif
+}
+
+/*! \brief Heap usage of a profiled function
+
+The heap usage is derived from the free heap memory before and after each call: allocations
+that are released before the call returns (e.g. temporary Strings) are not visible, only memory
+that is retained after the call. With `__USE_MUPPLET_ALLOC_COUNTING__`, every allocation is
+additionally counted by the \ref AllocCounter.
+*/
+class HeapStats {
+  public:
+    long growth = 0;            //!< net change of the used heap by all calls in bytes
+    long growthMax = 0;         //!< largest increase of the used heap by a single call in bytes
+    unsigned long lowFree = 0;  //!< lowest free heap after a call in bytes (watermark)
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    unsigned long allocs = 0;      //!< number of allocations by all calls
+    unsigned long allocBytes = 0;  //!< number of bytes requested by all calls
+#endif
+
+    void add(unsigned long freeBefore, unsigned long freeAfter) {
+        /*! Record a call
+        @param freeBefore Free heap before the call in bytes
+        @param freeAfter Free heap after the call in bytes
+        */
+        long used = (long)freeBefore - (long)freeAfter;
+        growth += used;
+        if (used > growthMax) {
+            growthMax = used;
+        }
+        if (!lowFree || freeAfter < lowFree) {
+            lowFree = freeAfter;
+        }
+    }
+
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    void addAllocs(const AllocCounter::Snapshot &before, const AllocCounter::Snapshot &after) {
+        /*! Record the allocations of a call
+        @param before Allocation counters before the call
+        @param after Allocation counters after the call
+        */
+        allocs += after.count - before.count;
+        allocBytes += after.bytes - before.bytes;
+    }
+#endif
+
+    void toJson(JsonWriter &json) {
+        /*! Write the heap statistics as JSON object members
+        @param json JsonWriter that receives the `heap`, `heapMax` and `heapLow` members (and
+                    `allocs` and `bytes` with allocation counting)
+        */
+        json.add("heap", growth);
+        json.add("heapMax", growthMax);
+        json.add("heapLow", (long)lowFree);
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        json.add("allocs", (long)allocs);
+        json.add("bytes", (long)allocBytes);
+#endif
+    }
+};
+
+/*! \brief Call statistics of a profiled function
+
+Counts the calls of a function and records the minimum, average and maximum execution time in
+microseconds and, with `__USE_MUPPLET_HEAP_PROFILING__`, the heap usage.
+*/
+class ProfileStats {
+  public:
+    unsigned long count = 0;  //!< number of calls
+    unsigned long minUs = 0;  //!< shortest call in microseconds
+    unsigned long maxUs = 0;  //!< longest call in microseconds
+    uint64_t totalUs = 0;     //!< sum of all calls in microseconds
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+    HeapStats heap;  //!< heap usage of all calls
+#endif
+
+    void add(unsigned long us) {
+        /*! Record a call
+        @param us Execution time of the call in microseconds
+        */
+        if (!count || us < minUs) {
+            minUs = us;
+        }
+        if (us > maxUs) {
+            maxUs = us;
+        }
+        totalUs += us;
+        ++count;
+    }
+
+    unsigned long avgUs() {
+        /*! Get the average execution time
+        @return Average execution time in microseconds, 0 if there were no calls
+        */
+        return count ? (unsigned long)(totalUs / count) : 0;
+    }
+
+    void toJson(JsonWriter &json, const char *key) {
+        /*! Write the statistics as JSON object
+        @param json JsonWriter that receives the object
+        @param key Key of the object
+        */
+        json.beginObject(key);
+        json.add("count", (long)count);
+        json.add("min", (long)minUs);
+        json.add("avg", (long)avgUs());
+        json.add("max", (long)maxUs);
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+        heap.toJson(json);
+#endif
+        json.endObject();
+    }
+};
+
+/*! \brief Scope guard that records the execution time of a scope in a \ref ProfileStats object
+ */
+class ProfileScope {
+  private:
+    ProfileStats &stats;
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+    unsigned long freeHeap;
+#endif
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    AllocCounter::Snapshot allocs;
+#endif
+    unsigned long start;
+
+  public:
+    ProfileScope(ProfileStats &stats) : stats(stats) {
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+        freeHeap = muppletFreeHeap();
+#endif
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        allocs = AllocCounter::get();
+#endif
+        start = micros();
+    }
+    ~ProfileScope() {
+        stats.add(micros() - start);
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        stats.heap.addAllocs(allocs, AllocCounter::get());
+#endif
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+        stats.heap.add(freeHeap, muppletFreeHeap());
+#endif
+    }
+};
+
+/*! \brief Scope guard that records the heap usage of a scope in a \ref HeapStats object
+ */
+class HeapScope {
+  private:
+    HeapStats &stats;
+    unsigned long freeHeap;
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    AllocCounter::Snapshot allocs;
+#endif
+
+  public:
+    HeapScope(HeapStats &stats) : stats(stats), freeHeap(muppletFreeHeap()) {
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        allocs = AllocCounter::get();
+#endif
+    }
+    ~HeapScope() {
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        stats.addAllocs(allocs, AllocCounter::get());
+#endif
+        stats.add(freeHeap, muppletFreeHeap());
+    }
+};
+
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+/*! \brief Allocations of the messages of one topic */
+class TopicAllocStats {
+  public:
+    String topic;              //!< topic of the messages
+    unsigned long count = 0;   //!< number of handled messages
+    unsigned long allocs = 0;  //!< number of allocations by all messages
+    unsigned long bytes = 0;   //!< number of bytes requested by all messages
+
+    void toJson(JsonWriter &json) {
+        /*! Write the statistics as JSON object with the topic as key
+        @param json JsonWriter that receives the object
+        */
+        json.beginObject(topic.c_str());
+        json.add("count", (long)count);
+        json.add("allocs", (long)allocs);
+        json.add("bytes", (long)bytes);
+        json.endObject();
+    }
+};
+#endif
+
+// clang-format off
+/*! \brief mupplet-core Runtime Profiler
+
+Every mupplet that is compiled with `__USE_MUPPLET_PROFILING__` defined records the number of
+calls and the minimum, average and maximum execution time of its scheduler loop and its message
+handler. Without `__USE_MUPPLET_PROFILING__`, the instrumentation macros are empty and the
+profiler is not compiled at all.
+
+The define must be set before the first mupplet header is included, e.g. as build flag
+`-D__USE_MUPPLET_PROFILING__`.
+
+All times are in microseconds. The statistics cover the time since the start of the mupplet.
+
+## Heap Usage
+
+With `__USE_MUPPLET_HEAP_PROFILING__` defined (implies `__USE_MUPPLET_PROFILING__`), the
+profiler additionally records the heap usage of `begin()`, the loop and the message handler of
+each mupplet (ESP8266 and ESP32 only). The heap usage is measured as difference of the free heap
+before and after each call, it covers the memory that is retained by a call, not temporary
+allocations that are released before the call returns:
+
+| member | comment
+| ------ | -------
+| `heap` | net change of the used heap by all calls in bytes (a growing value indicates a leak)
+| `heapMax` | largest increase of the used heap by a single call in bytes
+| `heapLow` | lowest free heap after a call in bytes
+
+The `begin` object contains the heap usage of the `begin()` method of the mupplet. The summary
+`mupplets/stats` contains the current free heap as `free`: comparing the summaries of two
+firmware releases shows which mupplet uses more memory.
+
+## Allocation Counting
+
+The free heap comparison does not show temporary allocations, e.g. the `String` churn of a
+message handler. With `__USE_MUPPLET_ALLOC_COUNTING__` defined (implies
+`__USE_MUPPLET_HEAP_PROFILING__`) and the linker flags described at \ref AllocCounter, every
+allocation is counted:
+
+| member | comment
+| ------ | -------
+| `allocs` | number of allocations by all calls
+| `bytes` | number of bytes requested by all calls
+
+Additionally, the allocations of the message handler are counted per topic (up to
+`USTD_PROFILER_MAX_TOPICS` topics per mupplet, further topics are only part of `msg`). The
+table `mupplets/allocs` contains the number of handled messages, allocations and bytes of every
+topic, grouped by mupplet. It can be saved and compared between firmware releases, see the example
+`muppletAllocBench`.
+
+## Messages
+
+### Messages sent by the profiler:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<mupplet-name>/stats` | `{"loop":{"count":1200,"min":12,"avg":15,"max":40},"msg":{...}}` | Statistics of a mupplet
+| `mupplets/stats` | `{"<mupplet-name>":{"loop":{...},"msg":{...}},...}` | Statistics of all profiled mupplets
+| `<mupplet-name>/stats` | `{"begin":{"heap":320,...},"loop":{...,"heap":0,"heapMax":0,"heapLow":41200},...}` | With heap profiling
+| `mupplets/stats` | `{"free":41080,"<mupplet-name>":{"begin":{...},"loop":{...},"msg":{...}},...}` | With heap profiling
+| `<mupplet-name>/stats` | `{...,"msg":{...,"allocs":12,"bytes":380},"topics":{"<topic>":{"count":2,"allocs":12,"bytes":380}}}` | With allocation counting
+| `mupplets/allocs` | `{"<mupplet-name>":{"<topic>":{"count":2,"allocs":12,"bytes":380},...},...}` | Allocations per topic of all mupplets
+
+### Message received by the profiler:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<mupplet-name>/stats/get` | | Publishes the statistics of a mupplet on `<mupplet-name>/stats`
+| `mupplets/stats/get` | | Publishes the statistics of all mupplets on `mupplets/stats`
+| `mupplets/allocs/get` | | With allocation counting: publishes the allocations per topic on `mupplets/allocs`
+
+## Instrumentation of a mupplet
+
+\code{cpp}
+#include "helper/mupplet_profiler.h"
+
+class MyMupplet {
+    ...
+    MUPPLET_PROFILER
+
+    void begin(Scheduler *_pSched) {
+        MUPPLET_PROFILE_SETUP();
+        ...
+        tID = pSched->add(ft, name, 50000);
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
+    }
+
+    void loop() {
+        MUPPLET_PROFILE_LOOP();
+        ...
+    }
+
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
+        ...
+    }
+};
+\endcode
+*/
+// clang-format on
+class MuppletProfiler {
+  public:
+    ProfileStats loopStats;  //!< statistics of the scheduler loop of the mupplet
+    ProfileStats msgStats;   //!< statistics of the message handler of the mupplet
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+    HeapStats beginStats;  //!< heap usage of the begin() method of the mupplet
+#endif
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    ustd::array<TopicAllocStats> topicStats;  //!< allocations of the message handler per topic
+#endif
+
+  private:
+    Scheduler *pSched = nullptr;
+    String name;
+    MuppletProfiler *pNext = nullptr;
+
+  public:
+    void begin(Scheduler *_pSched, int tID, String _name) {
+        /*! Register the profiler of a mupplet
+        @param _pSched Pointer to Scheduler object, used for pub/sub.
+        @param tID Task ID of the mupplet, used for the subscriptions
+        @param _name Name of the mupplet
+        */
+        if (pSched) {
+            return;
+        }
+        pSched = _pSched;
+        name = _name;
+        if (!first()) {
+            // the first profiled mupplet answers the summary requests
+            pSched->subscribe(tID, "mupplets/stats/get",
+                              [this](const String &topic, const String &msg,
+                                     const String &originator) { this->publishSummary(); });
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+            pSched->subscribe(tID, "mupplets/allocs/get",
+                              [this](const String &topic, const String &msg,
+                                     const String &originator) { this->publishAllocs(); });
+#endif
+        }
+        MuppletProfiler **ppLast = &first();
+        while (*ppLast) {
+            ppLast = &(*ppLast)->pNext;
+        }
+        *ppLast = this;
+        pSched->subscribe(tID, name + "/stats/get",
+                          [this](const String &topic, const String &msg, const String &originator) {
+                              this->publishStats();
+                          });
+    }
+
+    void toJson(JsonWriter &json) {
+        /*! Write the statistics of the mupplet as JSON object members
+        @param json JsonWriter that receives the `loop` and `msg` objects (and `begin` with heap
+                    profiling)
+        */
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+        json.beginObject("begin");
+        beginStats.toJson(json);
+        json.endObject();
+#endif
+        loopStats.toJson(json, "loop");
+        msgStats.toJson(json, "msg");
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        json.beginObject("topics");
+        for (unsigned int i = 0; i < topicStats.length(); i++) {
+            topicStats[i].toJson(json);
+        }
+        json.endObject();
+#endif
+    }
+
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    void addTopicAllocs(const String &topic, const AllocCounter::Snapshot &before,
+                        const AllocCounter::Snapshot &after) {
+        /*! Record the allocations of a handled message
+        @param topic Topic of the message
+        @param before Allocation counters before the message handler
+        @param after Allocation counters after the message handler
+        */
+        unsigned int i = 0;
+        while (i < topicStats.length() && topicStats[i].topic != topic) {
+            ++i;
+        }
+        if (i == topicStats.length()) {
+            if (i >= USTD_PROFILER_MAX_TOPICS) {
+                return;
+            }
+            TopicAllocStats entry;
+            entry.topic = topic;
+            topicStats.add(entry);
+        }
+        TopicAllocStats &stats = topicStats[i];
+        ++stats.count;
+        stats.allocs += after.count - before.count;
+        stats.bytes += after.bytes - before.bytes;
+    }
+#endif
+
+  private:
+    static MuppletProfiler *&first() {
+        static MuppletProfiler *pFirst = nullptr;
+        return pFirst;
+    }
+
+    void publishStats() {
+        JsonWriter json(128);
+        json.beginObject();
+        toJson(json);
+        json.endObject();
+        pSched->publish(name + "/stats", json.c_str());
+    }
+
+    void publishSummary() {
+        JsonWriter json(512);
+        json.beginObject();
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+        json.add("free", (long)muppletFreeHeap());
+#endif
+        for (MuppletProfiler *p = first(); p; p = p->pNext) {
+            json.beginObject(p->name.c_str());
+            p->toJson(json);
+            json.endObject();
+        }
+        json.endObject();
+        pSched->publish("mupplets/stats", json.c_str());
+    }
+
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    void publishAllocs() {
+        JsonWriter json(1024);
+        json.beginObject();
+        for (MuppletProfiler *p = first(); p; p = p->pNext) {
+            // mupplets can handle the same topic, e.g. `mqtt/state`
+            json.beginObject(p->name.c_str());
+            for (unsigned int i = 0; i < p->topicStats.length(); i++) {
+                p->topicStats[i].toJson(json);
+            }
+            json.endObject();
+        }
+        json.endObject();
+        pSched->publish("mupplets/allocs", json.c_str());
+    }
+#endif
+};
+
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+/*! \brief Scope guard that records the allocations of a message handler per topic
+ */
+class TopicAllocScope {
+  private:
+    MuppletProfiler &profiler;
+    const String &topic;
+    AllocCounter::Snapshot allocs;
+
+  public:
+    TopicAllocScope(MuppletProfiler &profiler, const String &topic)
+        : profiler(profiler), topic(topic), allocs(AllocCounter::get()) {
+    }
+    ~TopicAllocScope() {
+        // the counters are read before the entry of a new topic is allocated
+        profiler.addTopicAllocs(topic, allocs, AllocCounter::get());
+    }
+};
+#endif
+
+}  // namespace ustd
+
+//! Declares the profiler member of a mupplet
+#define MUPPLET_PROFILER ustd::MuppletProfiler muppletProfiler;
+#ifdef __USE_MUPPLET_HEAP_PROFILING__
+//! Records the heap usage of the enclosing scope, call at the beginning of `begin()`
+#define MUPPLET_PROFILE_SETUP() ustd::HeapScope muppletSetupScope(muppletProfiler.beginStats)
+#else
+#define MUPPLET_PROFILE_SETUP()
+#endif
+//! Registers the profiler of a mupplet, call in `begin()` after the task has been created
+#define MUPPLET_PROFILE_BEGIN(pSched, tID, name) muppletProfiler.begin(pSched, tID, name)
+//! Records the execution time of the enclosing scope as loop call
+#define MUPPLET_PROFILE_LOOP() ustd::ProfileScope muppletProfileScope(muppletProfiler.loopStats)
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+//! Records the execution time and allocations of the enclosing scope as message handler call
+#define MUPPLET_PROFILE_MSG(topic)                                                                 \
+    ustd::TopicAllocScope muppletTopicScope(muppletProfiler, topic);                               \
+    ustd::ProfileScope muppletProfileScope(muppletProfiler.msgStats)
+#else
+//! Records the execution time of the enclosing scope as message handler call
+#define MUPPLET_PROFILE_MSG(topic) ustd::ProfileScope muppletProfileScope(muppletProfiler.msgStats)
+#endif
+
+#else
+
+#define MUPPLET_PROFILER
+#define MUPPLET_PROFILE_SETUP()
+#define MUPPLET_PROFILE_BEGIN(pSched, tID, name)
+#define MUPPLET_PROFILE_LOOP()
+#define MUPPLET_PROFILE_MSG(topic)
+
+#endif  // __USE_MUPPLET_PROFILING__
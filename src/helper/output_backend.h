@@ -0,0 +1,54 @@
+// output_backend.h - interface for output hardware shared by several mupplets
+
+#pragma once
+
+#include "ustd_platform.h"
+
+namespace ustd {
+
+/*! \brief The Output Backend Interface
+ *
+ * An output backend provides a number of output channels that can be used by mupplets like
+ * \ref DigitalOut or \ref Light instead of a directly driven GPIO port. This allows to drive
+ * outputs that are multiplexed or expanded by dedicated hardware or software drivers (e.g.
+ * \ref BitAngleModulator).
+ *
+ * All values passed to an output backend are **physical** values: the mupplet using a channel
+ * is responsible for handling its `activeLogic`.
+ */
+class OutputBackend {
+  public:
+    virtual ~OutputBackend() {
+    }
+
+    /*! Get the number of available channels
+     * @return Number of channels provided by the backend
+     */
+    virtual uint8_t channelCount() = 0;
+
+    /*! Check if the backend supports intermediate output levels
+     * @return `true` if \ref setChannelLevel supports intermediate levels
+     */
+    virtual bool isDimmable() {
+        return false;
+    }
+
+    /*! Set the physical state of an output channel
+     * @param channel Channel number [0 .. \ref channelCount() - 1]
+     * @param on `true` sets the output to HIGH, `false` to LOW
+     */
+    virtual void setChannel(uint8_t channel, bool on) = 0;
+
+    /*! Set the physical output level of an output channel
+     *
+     * Backends that are not dimmable switch the channel on for all levels above 0.5.
+     *
+     * @param channel Channel number [0 .. \ref channelCount() - 1]
+     * @param level Output level [0.0 (LOW) - 1.0 (HIGH)]
+     */
+    virtual void setChannelLevel(uint8_t channel, double level) {
+        setChannel(channel, level > 0.5);
+    }
+};
+
+}  // namespace ustd
@@ -0,0 +1,210 @@
+// publish_filter.h - suppression of duplicate and coalescing of rapid state messages
+
+#pragma once
+
+#include "scheduler.h"
+#include "ustd_array.h"
+#include "mupplet_core.h"
+
+namespace ustd {
+
+// clang-format off
+/*! \brief Publish Filter
+
+Mupplets often publish the same value of a state topic several times, e.g. brightness, effect
+and color of a light are republished on every update even if only one of them changed. The
+publish filter remembers the last published value of every state topic of a mupplet and can:
+
+* suppress duplicates: a message is not published if its topic already has the same value
+* coalesce rapid changes: a topic is published at most once per coalescing window; changes
+  within the window are collected and only the last value is published when the window ends
+
+Both options are independent and can be changed at runtime with \ref configure. Messages that
+are published with `force` (e.g. answers to `<topic>/get` requests, periodic refreshes or the
+state replay after an MQTT connect) are always published immediately.
+
+If coalescing is used, \ref loop must be called regularly, usually from the loop of the
+mupplet.
+
+## Integration into a mupplet
+
+\code{cpp}
+#include "helper/publish_filter.h"
+
+class MyMupplet {
+    PublishFilter publisher;
+
+    void begin(Scheduler *_pSched) {
+        pSched = _pSched;
+        publisher.begin(pSched);
+        ...
+    }
+
+    void loop() {
+        publisher.loop();
+        ...
+    }
+
+    void publishState(bool force = false) {
+        publisher.publish(name + "/mystate", state ? "on" : "off", force);
+    }
+};
+\endcode
+*/
+// clang-format on
+class PublishFilter {
+  private:
+    typedef struct {
+        uint32_t hash;
+        String topic;
+        String value;    // last published value
+        String pending;  // coalesced value that is published when the window ends
+        unsigned long lastPublish;
+        bool hasPending;
+        bool valid;  // false after invalidate(): the next message is published in any case
+    } Entry;
+
+    Scheduler *pSched = nullptr;
+    bool suppressDuplicates;
+    unsigned long coalesceMs;
+    ustd::array<Entry> entries;
+
+  public:
+    PublishFilter(bool suppressDuplicates = true, unsigned long coalesceMs = 0)
+        : suppressDuplicates(suppressDuplicates), coalesceMs(coalesceMs) {
+        /*! Instantiate a publish filter
+        @param suppressDuplicates If `true`, messages with an unchanged value are not published
+        @param coalesceMs Coalescing window in ms, 0 publishes every change immediately
+        */
+    }
+
+    void begin(Scheduler *_pSched) {
+        /*! Start operation
+        @param _pSched Pointer to Scheduler object, used for publishing.
+        */
+        pSched = _pSched;
+    }
+
+    void configure(bool suppressDuplicates, unsigned long coalesceMs = 0) {
+        /*! Change the filter options
+        @param suppressDuplicates If `true`, messages with an unchanged value are not published
+        @param coalesceMs Coalescing window in ms, 0 publishes every change immediately
+        */
+        this->suppressDuplicates = suppressDuplicates;
+        this->coalesceMs = coalesceMs;
+        if (!coalesceMs) {
+            flush();
+        }
+    }
+
+    void publish(const String &topic, const String &msg, bool force = false) {
+        /*! Publish a state message through the filter
+        @param topic Topic of the message
+        @param msg Message body
+        @param force If `true`, the message is published immediately in any case
+        */
+        if (!pSched) {
+            return;
+        }
+        if (!suppressDuplicates && !coalesceMs) {
+            pSched->publish(topic, msg);
+            return;
+        }
+        uint32_t h = fnv1a(topic.c_str());
+        int index = find(topic, h);
+        if (index == -1) {
+            if (!force) {
+                // topics that are only published on request (force) are not remembered
+                Entry entry = {h, topic, msg, "", millis(), false, true};
+                entries.add(entry);
+            }
+            pSched->publish(topic, msg);
+            return;
+        }
+        Entry &entry = entries[index];
+        if (!force && entry.valid) {
+            if (suppressDuplicates && entry.value == msg) {
+                // the value is back to the published one: nothing to publish
+                entry.hasPending = false;
+                entry.pending = "";
+                return;
+            }
+            if (coalesceMs && timeDiff(entry.lastPublish, millis()) < coalesceMs) {
+                entry.pending = msg;
+                entry.hasPending = true;
+                return;
+            }
+        }
+        send(entry, msg);
+    }
+
+    void loop() {
+        /*! Publish coalesced messages whose coalescing window has ended
+
+        Must be called regularly if coalescing is used, usually from the loop of the mupplet.
+        */
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            Entry &entry = entries[i];
+            if (entry.hasPending && timeDiff(entry.lastPublish, millis()) >= coalesceMs) {
+                send(entry, entry.pending);
+            }
+        }
+    }
+
+    void flush() {
+        /*! Publish all coalesced messages immediately */
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            if (entries[i].hasPending) {
+                send(entries[i], entries[i].pending);
+            }
+        }
+    }
+
+    bool hasPending() {
+        /*! Check if coalesced messages wait for the end of their window
+
+        While a message is pending, the last published value of its topic (e.g. the answer of a
+        \ref StateCache) is outdated.
+
+        @return `true` if at least one message is pending
+        */
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            if (entries[i].hasPending) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void invalidate() {
+        /*! Forget all published values
+
+        The next message of every topic is published, even if its value did not change.
+        */
+        flush();
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            entries[i].valid = false;
+        }
+    }
+
+  private:
+    int find(const String &topic, uint32_t h) {
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            if (entries[i].hash == h && entries[i].topic == topic) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void send(Entry &entry, const String &msg) {
+        entry.value = msg;  // msg may be the pending value that is cleared next
+        entry.pending = "";
+        entry.hasPending = false;
+        entry.valid = true;
+        entry.lastPublish = millis();
+        pSched->publish(entry.topic, entry.value);
+    }
+};
+
+}  // namespace ustd
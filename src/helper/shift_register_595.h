@@ -0,0 +1,238 @@
+// shift_register_595.h - output expander backend for daisy-chained 74HC595 shift registers
+
+#pragma once
+
+#include "ustd_platform.h"
+#include "scheduler.h"
+#include "helper/output_backend.h"
+#ifdef USTD_FEATURE_SR595_SPI
+#include <SPI.h>
+#endif
+
+namespace ustd {
+
+#define USTD_SR595_MAX_CHIPS (16)
+
+// clang-format off
+/*! \brief mupplet-core 74HC595 Shift Register Output Backend
+
+The shift register backend drives a chain of up to 16 daisy-chained 74HC595 shift registers
+(8 outputs each). Every output bit is exposed as a channel of an \ref OutputBackend, so that it
+can be used by \ref DigitalOut or \ref Light with the usual topics.
+
+All channel states are kept in a shadow byte array. Changes only mark the shadow array as dirty;
+the whole chain is clocked out once per scheduler tick, so that 64 outputs cost one transfer per
+tick, regardless of how many of them have changed.
+
+Channel 0 is output `Q0` of the first shift register (the one connected to the
+microcontroller), channel 8 is output `Q0` of the second shift register and so on.
+
+The data is transferred by fast bit-banging. On ESP8266 (GPIO 0-15) and ESP32 (GPIO 0-31),
+bit-banging writes the GPIO set and clear registers directly. If `USTD_FEATURE_SR595_SPI` is
+defined before including this header, the data can alternatively be transferred with a hardware
+SPI interface. Without the define, `<SPI.h>` is not included.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "helper/shift_register_595.h"
+#include "mup_digital_out.h"
+#include "mup_light.h"
+
+ustd::Scheduler sched;
+ustd::ShiftRegister595 sr("sr", D8, D7, D5, 2);   // latch, data, clock, 2 chips = 16 outputs
+ustd::DigitalOut relay1("relay1", &sr, 0);
+ustd::DigitalOut relay2("relay2", &sr, 1);
+ustd::Light indicator("indicator", &sr, 8, true);
+
+void setup() {
+    sr.begin(&sched);    // bit-banging, with USTD_FEATURE_SR595_SPI: sr.begin(&sched, &SPI);
+    relay1.begin(&sched);
+    relay2.begin(&sched);
+    indicator.begin(&sched);
+}
+\endcode
+*/
+// clang-format on
+class ShiftRegister595 : public OutputBackend {
+  public:
+    static const char *version;  // = "0.1.0";
+
+  private:
+    // muwerk task management
+    Scheduler *pSched = nullptr;
+    int tID;
+    String name;
+
+    // device configuration
+    uint8_t latchPin;
+    uint8_t dataPin;
+    uint8_t clockPin;
+    uint8_t chips;
+#ifdef USTD_FEATURE_SR595_SPI
+    SPIClass *pSpi = nullptr;
+    uint32_t spiFrequency;
+#endif
+
+    // runtime
+    uint8_t shadow[USTD_SR595_MAX_CHIPS];
+    bool dirty = true;
+
+  public:
+    ShiftRegister595(String name, uint8_t latchPin, uint8_t dataPin, uint8_t clockPin,
+                     uint8_t chips = 1)
+        : name(name), latchPin(latchPin), dataPin(dataPin), clockPin(clockPin), chips(chips) {
+        /*! Instantiate a shift register output backend
+
+        No hardware interaction is performed, until \ref begin() is called.
+
+        @param name Name of the backend, used as name of the transfer task
+        @param latchPin GPIO connected to the storage register clock (`RCLK`, pin 12)
+        @param dataPin GPIO connected to the serial data input (`SER`, pin 14) of the first chip.
+                       Ignored when using hardware SPI.
+        @param clockPin GPIO connected to the shift register clock (`SRCLK`, pin 11). Ignored
+                        when using hardware SPI.
+        @param chips Number of daisy-chained shift registers [1 .. 16]
+        */
+        if (this->chips < 1)
+            this->chips = 1;
+        if (this->chips > USTD_SR595_MAX_CHIPS)
+            this->chips = USTD_SR595_MAX_CHIPS;
+        memset(shadow, 0, sizeof(shadow));
+    }
+
+    void begin(Scheduler *_pSched, unsigned long intervalUs = 10000) {
+        /*! Initialize the GPIOs, clear all outputs and start the transfer task
+
+        The data is transferred by bit-banging.
+
+        @param _pSched Pointer to Scheduler object, used for the internal transfer task
+        @param intervalUs Interval in microseconds in which changed outputs are transferred
+        */
+        pSched = _pSched;
+        pinMode(latchPin, OUTPUT);
+        digitalWrite(latchPin, LOW);
+#ifdef USTD_FEATURE_SR595_SPI
+        if (!pSpi) {
+#endif
+            pinMode(dataPin, OUTPUT);
+            pinMode(clockPin, OUTPUT);
+            digitalWrite(clockPin, LOW);
+#ifdef USTD_FEATURE_SR595_SPI
+        }
+#endif
+        flush();
+
+        auto ft = [=]() { this->loop(); };
+        tID = pSched->add(ft, name, intervalUs);
+    }
+
+#ifdef USTD_FEATURE_SR595_SPI
+    void begin(Scheduler *_pSched, SPIClass *_pSpi, uint32_t _spiFrequency = 4000000,
+               unsigned long intervalUs = 10000) {
+        /*! Initialize the GPIOs, clear all outputs and start the transfer task
+
+        The data is transferred with hardware SPI (requires `USTD_FEATURE_SR595_SPI`).
+
+        @param _pSched Pointer to Scheduler object, used for the internal transfer task
+        @param _pSpi Pointer to an initialized `SPIClass` object (e.g. `&SPI`), `nullptr` uses
+                     bit-banging.
+        @param _spiFrequency SPI clock frequency in Hz (default: 4MHz)
+        @param intervalUs Interval in microseconds in which changed outputs are transferred
+        */
+        pSpi = _pSpi;
+        spiFrequency = _spiFrequency;
+        begin(_pSched, intervalUs);
+    }
+#endif
+
+    void flush() {
+        /*! Transfer the shadow array to the shift registers immediately
+
+        This is called automatically once per tick if any channel has changed.
+        */
+        dirty = false;
+        // the last byte pushed into the chain ends up in the first chip
+#ifdef USTD_FEATURE_SR595_SPI
+        if (pSpi) {
+            pSpi->beginTransaction(SPISettings(spiFrequency, MSBFIRST, SPI_MODE0));
+            for (int i = chips - 1; i >= 0; i--) {
+                pSpi->transfer(shadow[i]);
+            }
+            pSpi->endTransaction();
+        } else {
+#endif
+            for (int i = chips - 1; i >= 0; i--) {
+                shiftByte(shadow[i]);
+            }
+#ifdef USTD_FEATURE_SR595_SPI
+        }
+#endif
+        writePin(latchPin, HIGH);
+        writePin(latchPin, LOW);
+    }
+
+    virtual uint8_t channelCount() {
+        return chips * 8;
+    }
+
+    virtual void setChannel(uint8_t channel, bool on) {
+        if (channel >= chips * 8)
+            return;
+        uint8_t mask = 1 << (channel & 7);
+        uint8_t value = on ? shadow[channel >> 3] | mask : shadow[channel >> 3] & ~mask;
+        if (value != shadow[channel >> 3]) {
+            shadow[channel >> 3] = value;
+            dirty = true;
+        }
+    }
+
+    bool getChannel(uint8_t channel) {
+        /*! Get the physical state of an output channel
+        @param channel Channel number [0 .. \ref channelCount() - 1]
+        @return `true` if the output is HIGH
+        */
+        if (channel >= chips * 8)
+            return false;
+        return shadow[channel >> 3] & (1 << (channel & 7));
+    }
+
+  private:
+    void loop() {
+        if (dirty) {
+            flush();
+        }
+    }
+
+    static inline void writePin(uint8_t pin, bool level) {
+#if defined(__ESP32__)
+        if (pin < 32) {
+            REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, (uint32_t)1 << pin);
+            return;
+        }
+#elif defined(__ESP__)
+        if (pin < 16) {
+            if (level)
+                GPOS = (uint32_t)1 << pin;
+            else
+                GPOC = (uint32_t)1 << pin;
+            return;
+        }
+#endif
+        digitalWrite(pin, level);
+    }
+
+    void shiftByte(uint8_t value) {
+        for (uint8_t mask = 0x80; mask; mask >>= 1) {
+            writePin(dataPin, value & mask);
+            writePin(clockPin, HIGH);
+            writePin(clockPin, LOW);
+        }
+    }
+};
+
+const char *ShiftRegister595::version = "0.1.0";
+
+}  // namespace ustd
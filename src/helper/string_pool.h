@@ -0,0 +1,269 @@
+// string_pool.h - append-only string storage with interning
+
+#pragma once
+
+#include "ustd_platform.h"
+#include "ustd_array.h"
+#include "mupplet_core.h"
+
+namespace ustd {
+
+/*! \brief Reference to a string stored in a \ref StringPool
+
+A reference is only 16 bits wide. The value 0 always references the empty string.
+*/
+typedef uint16_t StringRef;
+
+/*! \brief Append-only String Pool with Interning
+
+The StringPool class stores zero terminated strings in a single growing buffer. Each distinct
+string is stored only once: adding a string that is already part of the pool returns a
+reference to the existing copy. Strings are referenced by a 16 bit \ref StringRef, which makes
+data structures that contain many strings considerably smaller than storing pointers to
+individually allocated copies.
+
+Additionally, the pool can reference string literals (or any other strings that remain valid
+for the lifetime of the pool) without copying them. Once a literal has been registered with
+\ref literal(), every \ref intern() of an identical string references the literal instead of
+storing a copy. The strings are read through ordinary pointers: on ESP32, string literals
+reside in memory mapped flash and are referenced there without taking RAM. On ESP8266, plain
+string literals reside in RAM; strings declared with `PSTR()`, `F()` or `PROGMEM` cannot be
+used, since flash cannot be read byte by byte.
+
+The pool stores at most 32767 bytes of strings. Strings are never removed.
+
+**Note:** The pointers returned by \ref get() are only valid until the next string is added
+to the pool, since the buffer may be relocated when it grows.
+
+## Sample Usage
+
+\code{cpp}
+ustd::StringPool pool;
+
+ustd::StringRef icon = pool.literal("mdi:lightbulb");
+ustd::StringRef a = pool.intern(String("mdi:lightbulb"));   // a == icon, nothing copied
+ustd::StringRef b = pool.intern("kitchen");                  // stored in the pool
+ustd::StringRef c = pool.intern("kitchen");                  // c == b
+
+Serial.println(pool.get(b));
+\endcode
+*/
+class StringPool {
+  private:
+    static const StringRef literalFlag = 0x8000;
+    static const StringRef emptySlot = 0xffff;
+
+    char *buffer = nullptr;
+    size_t used = 0;
+    size_t capacity = 0;
+    size_t increment;
+    ustd::array<const char *> literals;
+    StringRef *slots = nullptr;
+    uint16_t slotCount = 0;
+    uint16_t entries = 0;
+    bool overflow = false;
+
+  public:
+    StringPool(size_t increment = 128, unsigned int maxLiterals = 256)
+        : increment(increment), literals(4, maxLiterals, 4) {
+        /*! Instantiate a string pool
+
+        Memory is allocated on first use.
+
+        @param increment Number of bytes by which the pool buffer grows
+        @param maxLiterals Maximum number of literals that can be registered
+        */
+    }
+
+    ~StringPool() {
+        if (buffer) {
+            free(buffer);
+        }
+        if (slots) {
+            free(slots);
+        }
+    }
+
+    StringRef intern(const char *str) {
+        /*! Add a string to the pool
+
+        If an identical string or literal is already part of the pool, no memory is allocated.
+
+        @param str String to add
+        @return Reference to the stored string. If memory is exhausted, the reference to the
+                empty string is returned.
+        */
+        if (!str || !*str) {
+            return 0;
+        }
+        StringRef ref = find(str);
+        if (ref != emptySlot) {
+            return ref;
+        }
+        size_t len = strlen(str) + 1;
+        if (!reserve(len)) {
+            return 0;
+        }
+        ref = (StringRef)used;
+        memcpy(buffer + used, str, len);
+        used += len;
+        insert(ref);
+        return ref;
+    }
+
+    StringRef intern(const String &str) {
+        /*! Add a string to the pool
+
+        If an identical string or literal is already part of the pool, no memory is allocated.
+
+        @param str String to add
+        @return Reference to the stored string. If memory is exhausted, the reference to the
+                empty string is returned.
+        */
+        return intern(str.c_str());
+    }
+
+    StringRef literal(const char *str) {
+        /*! Register a string literal without copying it
+
+        The string is referenced and must remain valid and unchanged for the lifetime of the
+        pool (e.g. a string literal, but no `PSTR()` string). All subsequent calls to
+        \ref intern() with an identical string will return a reference to this literal. If
+        the string is already part of the pool, the existing entry is returned.
+
+        @param str String literal to register
+        @return Reference to the literal. If the maximum number of literals is reached, the
+                string is copied into the pool instead.
+        */
+        if (!str || !*str) {
+            return 0;
+        }
+        StringRef ref = find(str);
+        if (ref != emptySlot) {
+            return ref;
+        }
+        int index = literals.add(str);
+        if (index == -1) {
+            return intern(str);
+        }
+        ref = literalFlag | (StringRef)index;
+        insert(ref);
+        return ref;
+    }
+
+    const char *get(StringRef ref) {
+        /*! Get a string from the pool
+        @param ref Reference to the string
+        @return Pointer to the zero terminated string
+        */
+        if (ref & literalFlag) {
+            return literals[ref & ~literalFlag];
+        }
+        return (buffer && ref < used) ? buffer + ref : "";
+    }
+
+    size_t getSize() {
+        /*! Get the number of bytes occupied by the stored strings
+        @return Number of bytes of stored strings (excluding literals)
+        */
+        return used;
+    }
+
+    bool isValid() {
+        /*! Check if all strings could be stored
+        @return `false` if memory was exhausted while adding a string
+        */
+        return !overflow;
+    }
+
+  private:
+    static uint16_t hash(const char *str) {
+        uint32_t h = fnv1a(str);
+        return (uint16_t)(h ^ (h >> 16));
+    }
+
+    bool reserve(size_t len) {
+        if (overflow || used + len >= literalFlag) {
+            overflow = true;
+            return false;
+        }
+        if (used + len <= capacity) {
+            return true;
+        }
+        size_t newCapacity = capacity;
+        while (newCapacity < used + len + (used ? 0 : 1)) {
+            newCapacity += increment;
+        }
+        char *newBuffer = (char *)realloc(buffer, newCapacity);
+        if (!newBuffer) {
+            overflow = true;
+            return false;
+        }
+        if (!buffer) {
+            // offset 0 is reserved for the empty string
+            newBuffer[0] = 0;
+            used = 1;
+        }
+        buffer = newBuffer;
+        capacity = newCapacity;
+        return true;
+    }
+
+    StringRef find(const char *str) {
+        if (!slotCount) {
+            return emptySlot;
+        }
+        uint16_t mask = slotCount - 1;
+        for (uint16_t i = hash(str) & mask;; i = (i + 1) & mask) {
+            if (slots[i] == emptySlot) {
+                return emptySlot;
+            }
+            if (!strcmp(get(slots[i]), str)) {
+                return slots[i];
+            }
+        }
+    }
+
+    void insert(StringRef ref) {
+        // keep the load factor of the open addressed hash table below 50%
+        if ((uint32_t)(entries + 1) * 2 > slotCount && slotCount < 0x8000) {
+            uint16_t newCount = slotCount ? slotCount * 2 : 16;
+            StringRef *newSlots = (StringRef *)malloc(newCount * sizeof(StringRef));
+            if (!newSlots) {
+                // the string remains usable, but will not be deduplicated
+                return;
+            }
+            memset(newSlots, 0xff, newCount * sizeof(StringRef));
+            StringRef *oldSlots = slots;
+            uint16_t oldCount = slotCount;
+            slots = newSlots;
+            slotCount = newCount;
+            entries = 0;
+            for (uint16_t i = 0; i < oldCount; i++) {
+                if (oldSlots[i] != emptySlot) {
+                    place(oldSlots[i]);
+                }
+            }
+            if (oldSlots) {
+                free(oldSlots);
+            }
+        }
+        place(ref);
+    }
+
+    void place(StringRef ref) {
+        if (entries + 1 >= slotCount) {
+            // the string remains usable, but will not be deduplicated
+            return;
+        }
+        uint16_t mask = slotCount - 1;
+        uint16_t i = hash(get(ref)) & mask;
+        while (slots[i] != emptySlot) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = ref;
+        ++entries;
+    }
+};
+
+}  // namespace ustd
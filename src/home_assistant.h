@@ -4,6 +4,9 @@
 #include "muwerk.h"
 #include "mupplet_core.h"
 #include "jsonfile.h"
+#include "helper/json_writer.h"
+#include "helper/string_pool.h"
+#include "helper/alloc_counter.h"
 
 #define USTD_FEATURE_HOMEASSISTANT
 
@@ -25,6 +28,8 @@ The HomeAssistant helper reacts to the following messages:
 | ---------------- | ------------- | -------------------------------------------------
 | `ha/state/set`   | `on` or `off` | Enables or disables entity discovery.
 | `ha/state/get`   |               | Requests the current entity discovery state.
+| `ha/discovery/get` |             | Requests the progress of the entity discovery.
+| `ha/discovery/set` | `refresh`   | Forces a full republish of all entity configurations.
 
 ### Outgoing Messages
 
@@ -32,8 +37,41 @@ The HomeAssistant helper reacts to the following messages:
 | ---------------------------- | ------------- | ---------------------------------------
 | `ha/state`                   | `on` or `off` | Current State of the entity discovery
 | `ha/attribs/<attribGroup>`   | `{ ... }`     | Current entity attributes (See below)
+| `ha/discovery`               | `{ ... }`     | Progress of the entity discovery (See below)
+
+Entity configurations are not sent all at once, since a device with many entities or
+multichannel entities would need to publish hundreds of messages: this would block the
+scheduler and overflow the outbound buffer of the MQTT connection. Instead, the discovery runs
+as a resumable background job that publishes a limited number of configurations per tick (see
+\ref setDiscoveryRate). The job restarts from the beginning whenever the MQTT connection is
+reestablished. Its progress is reported at start and end and on request:
+
+\code{json}
+{"state": "idle", "done": 49, "total": 49, "skipped": 45, "bytes": 1624, "avg": 406,
+ "ms": 512, "cpu_us": 21520, "heap": 31480, "heap_min": 29936}
+\endcode
+
+The `state` is one of `idle`, `publishing` or `unpublishing`.
+
+Entity configurations are retained by the MQTT broker. Therefore the discovery job keeps a
+compact hash of every configuration that was published successfully (persisted in the
+filesystem, if available) and skips all configurations that did not change since then. The
+hashes are kept per config topic, so adding or removing an entity does not affect the others.
+A reconnect usually costs only a handful of messages. The number of skipped configurations is
+reported as `skipped`, the payload size of the published configurations as `bytes` (total) and
+`avg` (average per configuration). `ms` is the elapsed time since the start of the job and
+`cpu_us` the time actually spent rendering and publishing. On ESP platforms `heap` reports the
+free heap at the start of the job and `heap_min` the lowest free heap seen during the job. See
+the example `haDiscoveryBench` for a benchmark that uses these statistics. With
+`__USE_MUPPLET_ALLOC_COUNTING__` (see \ref AllocCounter), `allocs` and `alloc_bytes` report the
+number of heap allocations and requested bytes of the job. A full republish can be forced with
+\ref refreshDiscovery or the `ha/discovery/set` message.
 
 Entity attributes are sent as JSON object and are displayed as attributes to an entity.
+To keep the payloads small, all configurations use abbreviated keys and the `~` base topic
+substitution. The full device information is sent only with the configuration of the device
+status sensor, all other entities reference the device by its identifier.
+
 The HomeAssistant Device Autodiscovery Helper always sends the attribute group `device`
 that will contain such data:
 
@@ -82,10 +120,37 @@ void setup() {
 }
 \endcode
 
+## Static Entity Tables
+
+Entities that are known at compile time can also be declared as a constant table of
+\ref EntityDef records. The table is iterated directly during the discovery and is neither
+copied into RAM nor does it cause any allocation at startup. On ESP8266 the table can be
+placed into flash with `PROGMEM`; the strings referenced by the table must be directly
+addressable string literals.
+
+\code{cpp}
+using ustd::HomeAssistant;
+
+const HomeAssistant::EntityDef haEntities[] PROGMEM = {
+    // type, name, value, channel, human, dev_cla, unit, icon, val_tpl, attribs, effects
+    {HomeAssistant::Sensor, "bme280", "temperature", -1, nullptr, "temperature", "°C"},
+    {HomeAssistant::Sensor, "bme280", "humidity", -1, nullptr, "humidity", "%"},
+    {HomeAssistant::LightDim, "panel", nullptr, -16},
+};
+
+void setup() {
+    ...
+    ha.begin(&sched, true);
+    ha.addEntities(haEntities, sizeof(haEntities) / sizeof(haEntities[0]));
+}
+\endcode
+
+Static tables and the runtime `add...()` methods can be freely combined.
+
 */
 class HomeAssistant {
   public:
-    static const char *version;  // = "0.1.0";
+    static const char *version;  // = "0.2.0";
 
     /// \brief HomeAssistant Device Type
     enum DeviceType {
@@ -101,15 +166,58 @@ class HomeAssistant {
         LightRGBWW     /// A color light with additional white compoenent that can be "tempered"
     };
 
+    /// \brief Static HomeAssistant Entity Definition
+    ///
+    /// Entity definitions can be declared as constant tables (see \ref addEntities). Unused
+    /// strings can be `nullptr` or omitted, unused times can be 0 or omitted. The channel must
+    /// always be specified.
+    struct EntityDef {
+        DeviceType type;      ///< Type of the entity
+        const char *name;     ///< Unique name of the referenced mupplet
+        const char *value;    ///< Name of the reported value (sensors only)
+        int channel;          ///< -1: no channels, >=0: channel number, <-1: -(channel count)
+        const char *human;    ///< Human readable name for HomeAssistant entity
+        const char *dev_cla;  ///< Device class of the entity
+        const char *unit;     ///< Unit of the reported value (sensors only)
+        const char *icon;     ///< Alternative icon
+        const char *val_tpl;  ///< Value template to extract the value (sensors only)
+        const char *attribs;  ///< Alternative attribute group
+        const char *effects;  ///< Comma-separated list of effect names (lights only)
+        int exp_aft;          ///< Expiration time in seconds (sensors only)
+        int off_dly;          ///< Delay in seconds until state is reset to off (binary sensors)
+        bool frc_upd;         ///< `true` to notify updates of unchanged values (sensors only)
+    };
+
   private:
     // internal type definitions
     typedef struct {
-        const char *name;
-        const char *manufacturer;
-        const char *model;
-        const char *version;
+        StringRef name;
+        StringRef manufacturer;
+        StringRef model;
+        StringRef version;
+        unsigned long lastPublish;
+        bool dirty;
     } Attributes;
 
+    // stored entity definition, all strings are kept in the string pool
+    typedef struct {
+        DeviceType type;
+        StringRef name;
+        StringRef value;
+        StringRef human;
+        StringRef unit;
+        StringRef icon;
+        StringRef val_tpl;
+        StringRef attribs;
+        StringRef effects;
+        StringRef dev_cla;
+        int channel;
+        int off_dly;
+        int exp_aft;
+        bool frc_upd;
+    } EntityConfig;
+
+    // resolved view of an entity definition, only valid until the next string is pooled
     typedef struct {
         DeviceType type;
         const char *name;
@@ -127,9 +235,11 @@ class HomeAssistant {
         bool frc_upd;
     } Entity;
 
+    enum DiscoveryState { DiscoveryIdle, DiscoveryPublishing, DiscoveryUnpublishing };
+
     // muwerk task management
     Scheduler *pSched;
-    int tID = SCHEDULER_MAIN;
+    int tID;
 
 #ifdef USTD_FEATURE_FILESYSTEM
     // configuration management
@@ -149,6 +259,9 @@ class HomeAssistant {
     bool autodiscovery = false;
     bool connected = false;
     long rssiVal = -99;
+    long publishedRssi = -99;
+    long rssiThreshold = 5;
+    unsigned long attribInterval = 60000;
     String macAddress;
     String ipAddress;
     String hostName;
@@ -156,9 +269,54 @@ class HomeAssistant {
     String lastWillTopic;
     String lastWillMessage;
 
+    typedef struct {
+        const EntityDef *pDefs;
+        unsigned int count;
+    } EntityTable;
+
+#ifdef USTD_FEATURE_STATE_AGGREGATOR
+    StateAggregator *pAggregator = nullptr;
+#endif
+
     // runtime - device data
+    JsonWriter json;
+    StringPool strings;
     ustd::array<Attributes> attribGroups;
-    ustd::array<Entity> entityConfigs;
+    ustd::array<EntityConfig> entityConfigs;
+    ustd::array<EntityTable> entityTables;
+
+    // runtime - discovery job
+    DiscoveryState discoveryState = DiscoveryIdle;
+    uint8_t discoveryRate = 4;
+    int discoveryEntity = -1;
+    int discoveryChannel = 0;
+    unsigned int discoveryDone = 0;
+    unsigned int discoveryTotal = 0;
+    unsigned int discoverySkipped = 0;
+    unsigned long discoveryBytes = 0;
+    unsigned long discoveryStart = 0;
+    unsigned long discoveryBusyUs = 0;
+    uint32_t discoveryHeap = 0;
+    uint32_t discoveryHeapMin = 0;
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+    unsigned long discoveryAllocs = 0;
+    unsigned long discoveryAllocBytes = 0;
+#endif
+    bool discoveryPublished = false;
+
+    // runtime - hashes of the published configurations, keyed by the hash of the config topic
+    typedef struct {
+        uint32_t topic;    // hash of the config topic
+        uint32_t config;   // hash of topic and configuration, 0 if not published
+        bool seen;         // the configuration still exists in the current pass
+        bool unconfirmed;  // written by the last pass, the broker may not have it yet
+    } ConfigHash;
+    ConfigHash *configHashes = nullptr;
+    unsigned int configHashCount = 0;
+    unsigned int configHashCapacity = 0;
+    bool configHashesChanged = false;
+    unsigned int passHashCount = 0;  // number of unconfirmed hashes written by the last pass
+    unsigned long passFinished = 0;
 
   public:
     /** Instantiate a HomeAssistant Autodiscovery Helper
@@ -176,11 +334,8 @@ class HomeAssistant {
     }
 
     virtual ~HomeAssistant() {
-        for (unsigned int i = 0; i < attribGroups.length(); i++) {
-            free((void *)attribGroups[i].name);
-        }
-        for (unsigned int i = 0; i < entityConfigs.length(); i++) {
-            free((void *)entityConfigs[i].name);
+        if (configHashes) {
+            free(configHashes);
         }
     }
 
@@ -189,13 +344,17 @@ class HomeAssistant {
      *                tasks and for message pub/sub.
      * @param initialAutodiscovery Initial state of the HomeAssistant Autodiscovery Helper if
      * not already saved into the filesystem.
+     * @param intervalUs Interval of the discovery job in microseconds (default: 50ms)
      */
-    void begin(Scheduler *_pSched, bool initialAutodiscovery = false) {
+    void begin(Scheduler *_pSched, bool initialAutodiscovery = false,
+               unsigned long intervalUs = 50000) {
         pSched = _pSched;
+        tID = pSched->add([this]() { this->loop(); }, "ha", intervalUs);
 
         // initialize configuration
 #ifdef USTD_FEATURE_FILESYSTEM
         autodiscovery = config.readBool("ha/autodiscovery", initialAutodiscovery);
+        loadConfigHashes(config.readString("ha/discoveryhashes"));
         if ((deviceId = config.readString("net/deviceid")) == "") {
             // initialize device id to mac address
             deviceId = WiFi.macAddress();
@@ -211,23 +370,28 @@ class HomeAssistant {
         addAttributes("device");
 
         // react to network state changes
-        pSched->subscribe(tID, "mqtt/config", [this](String topic, String msg, String orig) {
-            this->onMqttConfig(topic, msg, orig);
-        });
-        pSched->subscribe(tID, "mqtt/state", [this](String topic, String msg, String orig) {
-            this->onMqttState(topic, msg, orig);
-        });
-        pSched->subscribe(tID, "net/network", [this](String topic, String msg, String orig) {
-            this->onNetNetwork(topic, msg, orig);
-        });
-        pSched->subscribe(tID, "net/rssi", [this](String topic, String msg, String orig) {
-            this->onNetRssi(topic, msg, orig);
-        });
+        pSched->subscribe(tID, "mqtt/config", msgHandler(this, &HomeAssistant::onMqttConfig));
+        pSched->subscribe(tID, "mqtt/state", msgHandler(this, &HomeAssistant::onMqttState));
+        pSched->subscribe(tID, "net/network", msgHandler(this, &HomeAssistant::onNetNetwork));
+        pSched->subscribe(tID, "net/rssi", msgHandler(this, &HomeAssistant::onNetRssi));
 
         // react to commands
-        pSched->subscribe(tID, "ha/state/#", [this](String topic, String msg, String originator) {
-            this->onCommand(topic.substring(11), msg);
-        });
+        pSched->subscribe(tID, "ha/state/#",
+                          [this](const String &topic, const String &msg, const String &originator) {
+                              this->onCommand(topic.substring(11), msg);
+                          });
+        pSched->subscribe(tID, "ha/discovery/get",
+                          [this](const String &topic, const String &msg, const String &originator) {
+                              this->publishDiscoveryState();
+                          });
+        pSched->subscribe(tID, "ha/discovery/set",
+                          [this](const String &topic, const String &msg, const String &originator) {
+                              String command = msg;
+                              command.trim();
+                              if (command == "refresh") {
+                                  this->refreshDiscovery();
+                              }
+                          });
 
         // request current state
         pSched->publish("net/network/get");
@@ -251,10 +415,119 @@ class HomeAssistant {
 #endif
     }
 
+    /** Sets the number of configuration messages published per tick by the discovery job
+     *
+     * The discovery job publishes (or removes) the entity configurations in the background. Each
+     * channel of a multichannel entity counts as one message. Lower rates reduce the load on the
+     * MQTT connection, higher rates speed up the discovery.
+     *
+     * @param configsPerTick Number of configuration messages per tick [1 .. 255] (default: 4)
+     */
+    void setDiscoveryRate(uint8_t configsPerTick) {
+        discoveryRate = configsPerTick ? configsPerTick : 1;
+    }
+
+    /** Configures the rate limit of the attribute groups
+     *
+     * Attribute groups are only published if one of the included values has changed and at
+     * least `minIntervalMs` milliseconds have elapsed since their last publish. Changes of the
+     * signal strength are only considered if they exceed `rssiDelta`.
+     *
+     * @param minIntervalMs Minimum interval between two publishes of the same attribute group in
+     * milliseconds (default: 60000)
+     * @param rssiDelta Minimum change of the signal strength in dBm (default: 5)
+     */
+    void setAttributeRate(unsigned long minIntervalMs, long rssiDelta = 5) {
+        attribInterval = minIntervalMs;
+        rssiThreshold = rssiDelta;
+    }
+
+    /** Forces a full republish of all entity configurations
+     *
+     * Normally the discovery job skips all configurations that have not changed since their
+     * last successful publish. This discards the stored configuration hashes and restarts the
+     * discovery job, if autodiscovery is enabled and the MQTT connection is established.
+     */
+    void refreshDiscovery() {
+        configHashCount = 0;
+        configHashesChanged = true;
+        passHashCount = 0;
+        if (connected && autodiscovery) {
+            startDiscovery(DiscoveryPublishing);
+        }
+    }
+
+    /** Checks if the discovery job is running
+     * @return `true` if entity configurations are currently being published or removed
+     */
+    bool isDiscoveryRunning() {
+        return discoveryState != DiscoveryIdle;
+    }
+
+    /** Registers a string literal that is referenced by entity definitions without copying
+     *
+     * All strings of the entity definitions are stored only once, even if they are used by
+     * several entities. Strings like icons, units, device classes or effect lists that are
+     * available as literals can be registered before adding the entities: all entity
+     * definitions that use an identical string will then reference the literal and do not
+     * consume any additional heap memory for it. The literal must be directly addressable,
+     * `PSTR()` or `F()` strings are not supported.
+     *
+     * \code{cpp}
+     * ha.addLiteral("mdi:thermometer");
+     * ha.addSensor("bme280", "temperature", "", "temperature", "°C", "mdi:thermometer");
+     * \endcode
+     *
+     * @param str String literal. It must remain valid and unchanged for the lifetime of this
+     * object.
+     */
+    void addLiteral(const char *str) {
+        strings.literal(str);
+    }
+
+#ifdef USTD_FEATURE_STATE_AGGREGATOR
+    /** Uses the aggregated state document of a \ref StateAggregator
+     *
+     * Entities of mupplets that are registered with the state aggregator will be configured
+     * to read their states from the aggregated JSON document with matching value templates.
+     * Custom value templates of sensors receive the value of their topic as `value` (and
+     * `value_json`, if the template uses it).
+     *
+     * @param pAgg Pointer to the state aggregator
+     * @param blockIndividual If `true` (default), the aggregator is asked to block the
+     *                        individual messages of its mupplets (see \ref
+     *                        StateAggregator::enableBlocking), so that only the aggregated
+     *                        document reaches the broker
+     */
+    void setStateAggregator(StateAggregator *pAgg, bool blockIndividual = true) {
+        pAggregator = pAgg;
+        if (blockIndividual) {
+            pAgg->enableBlocking();
+        }
+    }
+#endif
+
+    /** Adds a constant table of entity definitions
+     *
+     * The table is referenced and iterated directly during the discovery, therefore it must
+     * remain valid for the lifetime of this object. On ESP8266 the table may be declared with
+     * `PROGMEM`. See \ref EntityDef for details.
+     *
+     * @param pDefs Pointer to the first entity definition of the table
+     * @param count Number of entity definitions in the table
+     */
+    void addEntities(const EntityDef *pDefs, unsigned int count) {
+        if (pDefs && count) {
+            EntityTable table = {pDefs, count};
+            entityTables.add(table);
+        }
+    }
+
     /** Adds a specific attribute group for the device
      *
      * By adding an attribute group, the device sends a full set of attributes every time the
-     * network state changes under the topic `ha/attribs/<attribGroup>`. The default attribute
+     * network state changes under the topic `ha/attribs/<attribGroup>` (rate limited, see
+     * \ref setAttributeRate). The default attribute
      * group 'device' is already defined automatically using the device information supplied in
      * the constructor. Adding additional attribute groups is only useful if specific entities
      * should provide more detailed information about the manufacturer of the hardware and/or
@@ -272,28 +545,19 @@ class HomeAssistant {
                        String version = "") {
 
         for (unsigned int i = 0; i < attribGroups.length(); i++) {
-            if (attribGroup == attribGroups[i].name) {
+            if (attribGroup == strings.get(attribGroups[i].name)) {
                 // insert only unique attribute groups
                 return;
             }
         }
 
         Attributes att = {};
-        String *man = manufacturer.length() ? &manufacturer : &deviceManufacturer;
-        String *mod = model.length() ? &model : &deviceModel;
-        String *ver = version.length() ? &version : &deviceVersion;
-
-        att.name = (char *)malloc(attribGroup.length() + man->length() + mod->length() +
-                                  ver->length() + 4);
-        if (att.name) {
-            att.manufacturer = copyfieldgetnext(att.name, attribGroup);
-            att.model = copyfieldgetnext(att.manufacturer, *man);
-            att.version = copyfieldgetnext(att.model, *mod);
-            strcpy((char *)att.version, ver->c_str());
-            if (attribGroups.add(att) == -1) {
-                free((void *)att.name);
-            }
-        }
+        att.name = strings.intern(attribGroup);
+        att.manufacturer =
+            strings.intern(manufacturer.length() ? manufacturer : deviceManufacturer);
+        att.model = strings.intern(model.length() ? model : deviceModel);
+        att.version = strings.intern(version.length() ? version : deviceVersion);
+        attribGroups.add(att);
     }
 
     /** Adds an entity definition for a switchable entity
@@ -604,27 +868,61 @@ class HomeAssistant {
     }
 
   protected:
-    void onMqttConfig(String topic, String msg, String originator) {
+    void loop() {
+        publishAttribs();
+        if (passHashCount && discoveryState == DiscoveryIdle &&
+            timeDiff(passFinished, millis()) > 2000) {
+            // the connection survived the pass: the configurations have reached the broker
+            for (unsigned int i = 0; i < configHashCount; i++) {
+                configHashes[i].unconfirmed = false;
+            }
+            passHashCount = 0;
+            saveConfigHashes();
+        }
+        // unchanged configurations are skipped and do not count against the rate, but the
+        // number of steps per tick is limited, since every step renders a configuration
+        unsigned int sent = 0;
+        unsigned int steps = 0;
+        unsigned long start = micros();
+        while (sent < discoveryRate && steps < discoveryRate * 8U &&
+               discoveryState != DiscoveryIdle) {
+            if (discoveryStep()) {
+                ++sent;
+            }
+            ++steps;
+        }
+        if (steps) {
+            discoveryBusyUs += micros() - start;
+        }
+    }
+
+    void onMqttConfig(const String &topic, const String &msg, const String &originator) {
         if (originator == "mqtt") {
             return;
         }
-        pathPrefix = shift(msg, '+');
-        lastWillTopic = shift(msg, '+');
-        lastWillMessage = shift(msg, '+');
+        String config = msg;
+        pathPrefix = shift(config, '+');
+        lastWillTopic = shift(config, '+');
+        lastWillMessage = shift(config, '+');
     }
 
-    void onMqttState(String topic, String msg, String originator) {
+    void onMqttState(const String &topic, const String &msg, const String &originator) {
         if (originator == "mqtt") {
             return;
         }
         bool previous = connected;
         connected = msg == "connected";
         if (connected != previous) {
+            if (!connected) {
+                // the job restarts from the beginning on reconnect
+                discoveryState = DiscoveryIdle;
+                invalidatePassHashes();
+            }
             updateHA();
         }
     }
 
-    void onNetNetwork(String topic, String msg, String originator) {
+    void onNetNetwork(const String &topic, const String &msg, const String &originator) {
         if (originator == "mqtt") {
             return;
         }
@@ -633,31 +931,38 @@ class HomeAssistant {
             return;
         }
         if (!strcmp((const char *)mqttMsg["state"], "connected")) {
-            ipAddress = (const char *)mqttMsg["ip"];
-            macAddress = (const char *)mqttMsg["mac"];
-            hostName = (const char *)mqttMsg["hostname"];
+            String ip = (const char *)mqttMsg["ip"];
+            String mac = (const char *)mqttMsg["mac"];
+            String host = (const char *)mqttMsg["hostname"];
+            if (ip != ipAddress || mac != macAddress || host != hostName) {
+                ipAddress = ip;
+                macAddress = mac;
+                hostName = host;
+                invalidateAttribs();
+            }
         }
     }
 
-    void onNetRssi(String topic, String msg, String originator) {
+    void onNetRssi(const String &topic, const String &msg, const String &originator) {
         if (originator == "mqtt") {
             return;
         }
         rssiVal = parseLong(msg, 0);
-        if (autodiscovery) {
-            publishAttribs();
+        if (abs(rssiVal - publishedRssi) >= rssiThreshold) {
+            invalidateAttribs();
         }
     }
 
-    void onCommand(String topic, String msg) {
+    void onCommand(const String &topic, const String &msg) {
         if (topic == "get") {
             publishState();
         } else if (topic == "set") {
-            msg.trim();
-            msg.toLowerCase();
-            if (msg == "on" || msg == "true") {
+            String state = msg;
+            state.trim();
+            state.toLowerCase();
+            if (state == "on" || state == "true") {
                 setAutoDiscovery(true);
-            } else if (msg == "off" || msg == "false") {
+            } else if (state == "off" || state == "false") {
                 setAutoDiscovery(false);
             }
         }
@@ -665,52 +970,106 @@ class HomeAssistant {
 
     void addGenericActor(DeviceType type, String name, int channel, String human = "",
                          String dev_cla = "", String icon = "", String attribs = "", String effects = "") {
-        size_t len = name.length() + human.length() + dev_cla.length() + icon.length() +
-                     attribs.length() + effects.length() + 6;
-        Entity entity = {};
-        entity.name = (const char *)malloc(len);
-        if (entity.name) {
-            entity.type = type;
-            entity.channel = channel;
-            entity.human = copyfieldgetnext(entity.name, name);
-            entity.dev_cla = copyfieldgetnext(entity.human, human);
-            entity.icon = copyfieldgetnext(entity.dev_cla, dev_cla);
-            entity.attribs = copyfieldgetnext(entity.icon, icon);
-            entity.effects = copyfieldgetnext(entity.attribs, attribs);
-            copyfieldgetnext(entity.effects, effects);
-            if (entityConfigs.add(entity) == -1) {
-                free((void *)entity.name);
-            }
-        }
+        EntityConfig entity = {};
+        entity.type = type;
+        entity.channel = channel;
+        entity.name = strings.intern(name);
+        entity.human = strings.intern(human);
+        entity.dev_cla = strings.intern(dev_cla);
+        entity.icon = strings.intern(icon);
+        entity.attribs = strings.intern(attribs);
+        entity.effects = strings.intern(effects);
+        entityConfigs.add(entity);
     }
 
     void addGenericSensor(DeviceType type, String name, String value, int channel,
                           String human = "", String dev_cla = "", String unit = "",
                           String icon = "", String val_tpl = "", int exp_aft = -1,
                           bool frc_upd = false, int off_dly = -1, String attribs = "") {
-        size_t len = name.length() + value.length() + human.length() + dev_cla.length() +
-                     unit.length() + icon.length() + val_tpl.length() + attribs.length() + 8;
+        EntityConfig entity = {};
+        entity.type = type;
+        entity.channel = channel;
+        entity.name = strings.intern(name);
+        entity.value = strings.intern(value);
+        entity.human = strings.intern(human);
+        entity.dev_cla = strings.intern(dev_cla);
+        entity.unit = strings.intern(unit);
+        entity.icon = strings.intern(icon);
+        entity.val_tpl = strings.intern(val_tpl);
+        entity.attribs = strings.intern(attribs);
+        entity.off_dly = off_dly;
+        entity.exp_aft = exp_aft;
+        entity.frc_upd = frc_upd;
+        entityConfigs.add(entity);
+    }
 
-        Entity entity = {};
-        entity.name = (const char *)malloc(len);
-        if (entity.name) {
-            entity.type = type;
-            entity.channel = channel;
-            entity.value = copyfieldgetnext(entity.name, name);
-            entity.human = copyfieldgetnext(entity.value, value);
-            entity.dev_cla = copyfieldgetnext(entity.human, human);
-            entity.unit = copyfieldgetnext(entity.dev_cla, dev_cla);
-            entity.icon = copyfieldgetnext(entity.unit, unit);
-            entity.val_tpl = copyfieldgetnext(entity.icon, icon);
-            entity.attribs = copyfieldgetnext(entity.val_tpl, val_tpl);
-            copyfieldgetnext(entity.attribs, attribs);
-            entity.off_dly = off_dly;
-            entity.exp_aft = exp_aft;
-            entity.frc_upd = frc_upd;
-            if (entityConfigs.add(entity) == -1) {
-                free((void *)entity.name);
+    unsigned int getEntityCount() {
+        unsigned int count = entityConfigs.length();
+        for (unsigned int i = 0; i < entityTables.length(); i++) {
+            count += entityTables[i].count;
+        }
+        return count;
+    }
+
+    Entity getEntity(unsigned int index) {
+        // runtime entities come first, followed by the static tables
+        if (index < entityConfigs.length()) {
+            return resolveEntity(entityConfigs[index]);
+        }
+        index -= entityConfigs.length();
+        for (unsigned int i = 0; i < entityTables.length(); i++) {
+            if (index < entityTables[i].count) {
+                EntityDef def;
+#if defined(__ESP__) && !defined(__ESP32__)
+                memcpy_P(&def, entityTables[i].pDefs + index, sizeof(def));
+#else
+                memcpy(&def, entityTables[i].pDefs + index, sizeof(def));
+#endif
+                return resolveEntity(def);
             }
+            index -= entityTables[i].count;
         }
+        Entity entity = {};
+        entity.type = Unknown;
+        return entity;
+    }
+
+    static Entity resolveEntity(EntityDef &def) {
+        Entity entity;
+        entity.type = def.type;
+        entity.name = def.name ? def.name : "";
+        entity.value = def.value ? def.value : "";
+        entity.human = def.human ? def.human : "";
+        entity.unit = def.unit ? def.unit : "";
+        entity.icon = def.icon ? def.icon : "";
+        entity.val_tpl = def.val_tpl ? def.val_tpl : "";
+        entity.attribs = def.attribs ? def.attribs : "";
+        entity.effects = def.effects ? def.effects : "";
+        entity.dev_cla = def.dev_cla ? def.dev_cla : "";
+        entity.channel = def.channel;
+        entity.off_dly = def.off_dly > 0 ? def.off_dly : -1;
+        entity.exp_aft = def.exp_aft > 0 ? def.exp_aft : -1;
+        entity.frc_upd = def.frc_upd;
+        return entity;
+    }
+
+    Entity resolveEntity(EntityConfig &config) {
+        Entity entity;
+        entity.type = config.type;
+        entity.name = strings.get(config.name);
+        entity.value = strings.get(config.value);
+        entity.human = strings.get(config.human);
+        entity.unit = strings.get(config.unit);
+        entity.icon = strings.get(config.icon);
+        entity.val_tpl = strings.get(config.val_tpl);
+        entity.attribs = strings.get(config.attribs);
+        entity.effects = strings.get(config.effects);
+        entity.dev_cla = strings.get(config.dev_cla);
+        entity.channel = config.channel;
+        entity.off_dly = config.off_dly;
+        entity.exp_aft = config.exp_aft;
+        entity.frc_upd = config.frc_upd;
+        return entity;
     }
 
     static const char *getDeviceClass(DeviceType type) {
@@ -735,36 +1094,58 @@ class HomeAssistant {
         return haTopicConfig + getDeviceClass(type) + "/" + uniq_id + "/config";
     }
 
-    void flushDeviceConfig(DeviceType type, JSONVar &msg) {
-        msg["dev"]["ids"][0] = deviceId;
-        msg["dev"]["name"] = deviceName;
-        msg["dev"]["mf"] = deviceManufacturer;
-        msg["dev"]["mdl"] = deviceModel;
-        msg["dev"]["sw"] = deviceVersion;
-        // too much of goodness...
-        // msg["dev"]["cns"][0][0] = "IP";
-        // msg["dev"]["cns"][0][1] = ipAddress;
-        // msg["dev"]["cns"][1][0] = "Host";
-        // msg["dev"]["cns"][1][1] = hostName;
-        pSched->publish(getConfigTopic(type, msg["uniq_id"]), JSON.stringify(msg));
-        // Serial.println("TOPIC:" + getConfigTopic(type, msg["uniq_id"]));
-        // Serial.println("      " + JSON.stringify(msg));
+    void flushDeviceConfig(DeviceType type, const String &uniq_id, bool fullDevice = false) {
+        // the full device block is only sent with the status sensor, all other entities
+        // reference the device by its identifier
+        json.beginObject("dev");
+        json.beginArray("ids");
+        json.addValue(deviceId.c_str());
+        json.endArray();
+        if (fullDevice) {
+            json.add("name", deviceName);
+            json.add("mf", deviceManufacturer);
+            json.add("mdl", deviceModel);
+            json.add("sw", deviceVersion);
+        }
+        json.endObject();
+        json.endObject();
+        if (!json.isValid()) {
+            return;
+        }
+        String topic = getConfigTopic(type, uniq_id.c_str());
+        uint32_t topicHash = fnv1a(topic.c_str());
+        uint32_t hash = fnv1a(json.c_str(), topicHash);
+        int index = findConfigHash(topicHash);
+        if (index != -1) {
+            configHashes[index].seen = true;
+            if (configHashes[index].config == hash) {
+                ++discoverySkipped;
+                return;
+            }
+        }
+        if (pSched->publish(topic, json.c_str())) {
+            discoveryPublished = true;
+            discoveryBytes += json.length();
+            setConfigHash(topicHash, hash, true);
+        }
     }
 
     void publishDeviceConfig() {
-        JSONVar msg;
-        msg["~"] = pathPrefix + "/";
-        msg["name"] = hostName + " Status";
-        msg["stat_t"] = "~ha/attribs/device";
-        msg["avty_t"] = "~mqtt/state";
-        msg["pl_avail"] = "connected";
-        msg["pl_not_avail"] = lastWillMessage;
-        msg["json_attr_t"] = "~ha/attribs/device";
-        msg["unit_of_meas"] = "%";
-        msg["val_tpl"] = "{{value_json['RSSI']}}";
-        msg["ic"] = "mdi:information-outline";
-        msg["uniq_id"] = deviceId + "_status";
-        flushDeviceConfig(DeviceType::Sensor, msg);
+        String uniq_id = deviceId + "_status";
+        json.reset();
+        json.beginObject();
+        json.add("~", pathPrefix.c_str(), "/");
+        json.add("name", hostName.c_str(), " Status");
+        json.add("stat_t", "~ha/attribs/device");
+        json.add("avty_t", "~mqtt/state");
+        json.add("pl_avail", "connected");
+        json.add("pl_not_avail", lastWillMessage);
+        json.add("json_attr_t", "~ha/attribs/device");
+        json.add("unit_of_meas", "%");
+        json.add("val_tpl", "{{value_json['RSSI']}}");
+        json.add("ic", "mdi:information-outline");
+        json.add("uniq_id", uniq_id);
+        flushDeviceConfig(DeviceType::Sensor, uniq_id, true);
     }
 
     static String getEntityName(Entity &entity) {
@@ -796,51 +1177,254 @@ class HomeAssistant {
         return entityTopic;
     }
 
-    void publishConfigs() {
-        // device config
-        publishDeviceConfig();
+    static int getEntityChannelCount(int channel) {
+        return channel < -1 ? -channel : 1;
+    }
+
+    void startDiscovery(DiscoveryState state) {
+        discoveryState = state;
+        discoveryEntity = -1;
+        discoveryChannel = 0;
+        discoveryDone = 0;
+        passHashCount = 0;
+        discoverySkipped = 0;
+        discoveryBytes = 0;
+        discoveryStart = millis();
+        discoveryBusyUs = 0;
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        discoveryAllocs = discoveryAllocBytes = 0;
+#endif
+#ifdef __ESP__
+        discoveryHeap = discoveryHeapMin = ESP.getFreeHeap();
+#endif
+        discoveryTotal = 1;
+        for (unsigned int i = 0; i < getEntityCount(); i++) {
+            discoveryTotal += getEntityChannelCount(getEntity(i).channel);
+        }
+        for (unsigned int i = 0; i < configHashCount; i++) {
+            configHashes[i].seen = false;
+            configHashes[i].unconfirmed = false;
+        }
+        if (state == DiscoveryPublishing) {
+            reserveConfigHashes(discoveryTotal);
+        }
+        publishDiscoveryState();
+    }
+
+    bool discoveryStep() {
+        // every step handles exactly one configuration message
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        AllocCounter::Snapshot allocs = AllocCounter::get();
+#endif
+        discoveryPublished = discoveryState == DiscoveryUnpublishing;
+        if (discoveryEntity == -1) {
+            if (discoveryState == DiscoveryPublishing) {
+                publishDeviceConfig();
+            } else {
+                unpublishDeviceConfig();
+            }
+            discoveryEntity = 0;
+        } else if (discoveryEntity < (int)getEntityCount()) {
+            Entity entity = getEntity(discoveryEntity);
+            if (discoveryState == DiscoveryPublishing) {
+                publishConfig(entity, discoveryChannel);
+            } else {
+                unpublishConfig(entity, discoveryChannel);
+            }
+            if (++discoveryChannel >= getEntityChannelCount(entity.channel)) {
+                discoveryChannel = 0;
+                ++discoveryEntity;
+            }
+        }
+        ++discoveryDone;
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        discoveryAllocs += AllocCounter::get().count - allocs.count;
+        discoveryAllocBytes += AllocCounter::get().bytes - allocs.bytes;
+#endif
+#ifdef __ESP__
+        uint32_t heap = ESP.getFreeHeap();
+        if (heap < discoveryHeapMin) {
+            discoveryHeapMin = heap;
+        }
+#endif
+        if (discoveryEntity >= (int)getEntityCount()) {
+            if (discoveryState == DiscoveryPublishing) {
+                // drop hashes of configurations that no longer exist
+                unsigned int count = 0;
+                for (unsigned int i = 0; i < configHashCount; i++) {
+                    if (configHashes[i].seen) {
+                        configHashes[count++] = configHashes[i];
+                    }
+                }
+                if (count != configHashCount) {
+                    configHashCount = count;
+                    configHashesChanged = true;
+                }
+            } else {
+                configHashCount = 0;
+                configHashesChanged = true;
+            }
+            discoveryState = DiscoveryIdle;
+            passFinished = millis();
+            if (!passHashCount) {
+                saveConfigHashes();
+            }
+            publishDiscoveryState();
+        }
+        return discoveryPublished;
+    }
+
+    int findConfigHash(uint32_t topicHash) {
+        for (unsigned int i = 0; i < configHashCount; i++) {
+            if (configHashes[i].topic == topicHash) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool reserveConfigHashes(unsigned int count) {
+        if (count <= configHashCapacity) {
+            return true;
+        }
+        ConfigHash *newHashes = (ConfigHash *)realloc(configHashes, count * sizeof(ConfigHash));
+        if (!newHashes) {
+            return false;
+        }
+        configHashes = newHashes;
+        configHashCapacity = count;
+        return true;
+    }
+
+    void setConfigHash(uint32_t topicHash, uint32_t hash, bool unconfirmed) {
+        int index = findConfigHash(topicHash);
+        if (index == -1) {
+            // grow geometrically, the table is usually sized once by startDiscovery()
+            if (configHashCount == configHashCapacity &&
+                !reserveConfigHashes(configHashCapacity ? configHashCapacity * 2 : 8)) {
+                return;
+            }
+            index = configHashCount++;
+            configHashes[index].topic = topicHash;
+            configHashes[index].unconfirmed = false;
+        }
+        ConfigHash &entry = configHashes[index];
+        entry.config = hash;
+        entry.seen = true;
+        if (unconfirmed && !entry.unconfirmed) {
+            entry.unconfirmed = true;
+            ++passHashCount;
+        }
+        configHashesChanged = true;
+    }
+
+    void invalidatePassHashes() {
+        // A successful publish only means that the configuration was queued locally. If the
+        // connection is lost during the pass or shortly after it, the broker may not have
+        // received them: the hashes written by the pass are discarded, so that these
+        // configurations are published again on the next pass.
+        for (unsigned int i = 0; i < configHashCount; i++) {
+            if (configHashes[i].unconfirmed) {
+                configHashes[i].config = 0;
+                configHashes[i].unconfirmed = false;
+                configHashesChanged = true;
+            }
+        }
+        passHashCount = 0;
+        saveConfigHashes();
+    }
+
+    void loadConfigHashes(String hashes) {
+        // hashes are stored as a sequence of pairs of 8 digit hex numbers: topic and config
+        unsigned int count = hashes.length() / 16;
+        reserveConfigHashes(count);
+        for (unsigned int i = 0; i < count; i++) {
+            setConfigHash(strtoul(hashes.substring(i * 16, i * 16 + 8).c_str(), nullptr, 16),
+                          strtoul(hashes.substring(i * 16 + 8, i * 16 + 16).c_str(), nullptr, 16),
+                          false);
+        }
+        configHashesChanged = false;
+    }
 
-        // entity configs
-        for (unsigned int i = 0; i < entityConfigs.length(); i++) {
-            publishConfig(entityConfigs[i]);
+    void saveConfigHashes() {
+        if (!configHashesChanged) {
+            return;
+        }
+        configHashesChanged = false;
+#ifdef USTD_FEATURE_FILESYSTEM
+        String hashes;
+        hashes.reserve(configHashCount * 16);
+        char buf[9];
+        for (unsigned int i = 0; i < configHashCount; i++) {
+            formatHex(buf, configHashes[i].topic, 8);
+            hashes += buf;
+            formatHex(buf, configHashes[i].config, 8);
+            hashes += buf;
         }
+        config.writeString("ha/discoveryhashes", hashes);
+#endif
+    }
+
+    void publishDiscoveryState() {
+        unsigned long sent = discoveryDone - discoverySkipped;
+        const char *state = discoveryState == DiscoveryPublishing     ? "publishing"
+                            : discoveryState == DiscoveryUnpublishing ? "unpublishing"
+                                                                      : "idle";
+        json.reset();
+        json.beginObject();
+        json.add("state", state);
+        json.add("done", (long)discoveryDone);
+        json.add("total", (long)discoveryTotal);
+        json.add("skipped", (long)discoverySkipped);
+        json.add("bytes", (long)discoveryBytes);
+        json.add("avg", (long)(sent ? discoveryBytes / sent : 0));
+        json.add("ms", (long)timeDiff(discoveryStart, millis()));
+        json.add("cpu_us", (long)discoveryBusyUs);
+#ifdef __ESP__
+        json.add("heap", (long)discoveryHeap);
+        json.add("heap_min", (long)discoveryHeapMin);
+#endif
+#ifdef __USE_MUPPLET_ALLOC_COUNTING__
+        json.add("allocs", (long)discoveryAllocs);
+        json.add("alloc_bytes", (long)discoveryAllocBytes);
+#endif
+        json.endObject();
+        pSched->publish("ha/discovery", json.c_str());
     }
 
-    void publishConfig(Entity &entity) {
+    void publishConfig(Entity &entity, int index) {
         String name = getEntityName(entity);
         String key = getEntityKey(entity);
         String topic = getEntityTopic(entity);
 
         if (entity.channel == -1) {
             publishConfig(entity, name, key, topic);
-        } else if (entity.channel < -1) {
-            for (int i = 0; i < abs(entity.channel); i++) {
-                publishConfig(entity, name + "." + i, key + "_" + i, topic + "/" + i);
-            }
         } else {
-            int i = entity.channel;
+            int i = entity.channel < -1 ? index : entity.channel;
             publishConfig(entity, name + "." + i, key + "_" + i, topic + "/" + i);
         }
     }
 
     void publishConfig(Entity &entity, String name, String key, String topic) {
-        JSONVar msg;
-        msg["~"] = pathPrefix + "/";
-        msg["name"] = hostName + " " + name;
-        msg["uniq_id"] = key;
-        msg["avty_t"] = "~mqtt/state";
-        msg["pl_avail"] = "connected";
-        msg["pl_not_avail"] = lastWillMessage;
-        msg["json_attr_t"] = "~" + haTopicAttrib + (*entity.attribs ? entity.attribs : "device");
+        json.reset();
+        json.beginObject();
+        json.add("~", pathPrefix.c_str(), "/");
+        json.add("name", hostName.c_str(), " ", name.c_str());
+        json.add("uniq_id", key);
+        json.add("avty_t", "~mqtt/state");
+        json.add("pl_avail", "connected");
+        json.add("pl_not_avail", lastWillMessage);
+        json.add("json_attr_t", "~", haTopicAttrib.c_str(),
+                 *entity.attribs ? entity.attribs : "device");
         if (*entity.dev_cla) {
-            msg["dev_cla"] = entity.dev_cla;
+            json.add("dev_cla", entity.dev_cla);
         }
         if (*entity.icon) {
-            msg["ic"] = entity.icon;
+            json.add("ic", entity.icon);
         }
         switch (entity.type) {
         // case DeviceType::Cover:
-        //     publishCoverConfig(msg, entity, topic);
+        //     publishCoverConfig(entity, topic);
         //     break;
         case DeviceType::Light:
         case DeviceType::LightDim:
@@ -848,154 +1432,206 @@ class HomeAssistant {
         case DeviceType::LightRGBW:
         case DeviceType::LightRGBWW:
         case DeviceType::LightWW:
-            publishLightConfig(msg, entity, topic);
+            publishLightConfig(entity, topic);
             break;
         case DeviceType::Sensor:
         case DeviceType::BinarySensor:
-            publishSensorConfig(msg, entity, topic);
+            publishSensorConfig(entity, topic);
             break;
         case DeviceType::Switch:
-            publishSwitchConfig(msg, entity, topic);
+            publishSwitchConfig(entity, topic);
             break;
         default:
-            break;
+            return;
         }
+        flushDeviceConfig(entity.type, key);
     }
 
-    void publishLightConfig(JSONVar &msg, Entity &entity, String &topic) {
-        msg["stat_t"] = "~" + topic + "/state";
-        msg["cmd_t"] = hostName + "/" + topic + "/set";
-        msg["payload_on"] = "on";
-        msg["payload_off"] = "off";
+    void publishLightConfig(Entity &entity, String &topic) {
+        addStateTopic(entity, "stat_t", "stat_val_tpl", topic, "state");
+        json.add("cmd_t", hostName.c_str(), "/", topic.c_str(), "/set");
+        json.add("pl_on", "on");
+        json.add("pl_off", "off");
 
         if (entity.type == LightDim || entity.type == LightWW) {
             // add support for brightness
-            msg["bri_cmd_t"] = hostName + "/" + topic + "/set";
-            msg["bri_scl"] = "100";
-            msg["bri_stat_t"] = "~" + topic + "/unitbrightness";
-            msg["bri_val_tpl"] = "{{ value | float * 100 | round(0) }}";
-            msg["on_cmd_type"] = "brightness";
+            json.add("bri_cmd_t", hostName.c_str(), "/", topic.c_str(), "/set");
+            json.add("bri_scl", 100);
+            addStateTopic(entity, "bri_stat_t", "bri_val_tpl", topic, "unitbrightness",
+                          " | float * 100 | round(0) }}");
+            json.add("on_cmd_type", "brightness");
         }
         if (entity.type == LightRGB || entity.type == LightRGBW || entity.type == LightRGBWW) {
             // add support for brightness
-            msg["bri_cmd_t"] = hostName + "/" + topic + "/set";
-            msg["bri_scl"] = "100";
-            msg["bri_stat_t"] = "~" + topic + "/unitbrightness";
-            msg["bri_val_tpl"] = "{{ value | float * 100 | round(0) }}";
-            msg["on_cmd_type"] = "first";
+            json.add("bri_cmd_t", hostName.c_str(), "/", topic.c_str(), "/set");
+            json.add("bri_scl", 100);
+            addStateTopic(entity, "bri_stat_t", "bri_val_tpl", topic, "unitbrightness",
+                          " | float * 100 | round(0) }}");
+            json.add("on_cmd_type", "first");
             // color
-            msg["color_mode"] = true;
+            json.add("clrm", true);
+            json.beginArray("sup_clrm");
             switch (entity.type) {
             case LightRGB:
-                msg["supported_color_modes"] = {"rgb"};
+                json.addValue("rgb");
                 break;
             case LightRGBW:
-                msg["supported_color_modes"] = {"rgbw"};
+                json.addValue("rgbw");
                 break;
             case LightRGBWW:
-                msg["supported_color_modes"] = {"rgbww"};
+                json.addValue("rgbww");
                 break;
             default:
                 break;  // compiler shutup.
             }
-            msg["rgb_cmd_t"] = hostName + "/" + topic + "/color/set";
-            msg["rgb_stat_t"] = "~" + topic + "/color";
-            if (strcmp(entity.effects, "")) {  // Effects are defined:
-                msg["effect_command_topic"] = hostName + "/" + topic + "/effect/set";
-                msg["effect_state_topic"] = "~" + topic + "/effect";
-                // entity.effects contains a string with a comma-separated list of effect-names (e.g. "effect 1, effect2 "), make them into a JSON array:
-                JSONVar elst;
-                int ind, n;
-                n = 0;
-                String effs = entity.effects;
-                ind = effs.indexOf(',');
-                while (ind != -1) {
-                    String tmp = effs.substring(0, ind);
-                    tmp.trim();
-                    elst[n] = tmp;
-                    n += 1;
-                    effs = effs.substring(ind + 1);
-                    ind = effs.indexOf(',');
+            json.endArray();
+            json.add("rgb_cmd_t", hostName.c_str(), "/", topic.c_str(), "/color/set");
+            addStateTopic(entity, "rgb_stat_t", "rgb_val_tpl", topic, "color");
+            if (*entity.effects) {  // Effects are defined:
+                json.add("fx_cmd_t", hostName.c_str(), "/", topic.c_str(), "/effect/set");
+                addStateTopic(entity, "fx_stat_t", "fx_val_tpl", topic, "effect");
+                // entity.effects contains a comma-separated list of effect-names (e.g. "effect 1,
+                // effect2 "), emit them as JSON array without creating temporary strings:
+                json.beginArray("fx_list");
+                const char *p = entity.effects;
+                while (*p) {
+                    const char *end = strchr(p, ',');
+                    if (!end) {
+                        end = p + strlen(p);
+                    }
+                    const char *first = p;
+                    const char *last = end;
+                    while (first < last && isspace(*first)) {
+                        ++first;
+                    }
+                    while (last > first && isspace(*(last - 1))) {
+                        --last;
+                    }
+                    json.addValue(first, last - first);
+                    p = *end ? end + 1 : end;
                 }
-                String tmp = effs;
-                tmp.trim();
-                elst[n] = tmp;
-                msg["effect_list"] = elst;  // JSON array, each element contains the name of one effect.
+                json.endArray();
             }
         }
-        flushDeviceConfig(entity.type, msg);
     }
 
-    void publishSensorConfig(JSONVar &msg, Entity &entity, String &topic) {
-        msg["stat_t"] = "~" + topic + "/" + entity.value;
+    void publishSensorConfig(Entity &entity, String &topic) {
         if (*entity.val_tpl) {
-            msg["val_tpl"] = entity.val_tpl;
+            addCustomStateTopic(entity, topic);
+        } else {
+            addStateTopic(entity, "stat_t", "val_tpl", topic, entity.value);
         }
         if (*entity.unit) {
-            msg["unit_of_meas"] = entity.unit;
+            json.add("unit_of_meas", entity.unit);
         }
         if (entity.exp_aft != -1) {
-            msg["exp_aft"] = entity.exp_aft;
+            json.add("exp_aft", entity.exp_aft);
         }
         if (entity.frc_upd) {
-            msg["frc_upd"] = "true";
+            json.add("frc_upd", true);
         }
-        flushDeviceConfig(entity.type, msg);
     }
 
-    void publishSwitchConfig(JSONVar &msg, Entity &entity, String &topic) {
-        msg["stat_t"] = "~" + topic + "/state";
-        msg["cmd_t"] = hostName + "/" + topic + "/set";
-        msg["payload_on"] = "on";
-        msg["payload_off"] = "off";
-        if (*entity.dev_cla) {
-            msg["dev_cla"] = entity.dev_cla;
-        }
-        flushDeviceConfig(entity.type, msg);
+    void publishSwitchConfig(Entity &entity, String &topic) {
+        addStateTopic(entity, "stat_t", "val_tpl", topic, "state");
+        json.add("cmd_t", hostName.c_str(), "/", topic.c_str(), "/set");
+        json.add("pl_on", "on");
+        json.add("pl_off", "off");
     }
 
-    void unpublishConfigs() {
-        // device config
-        pSched->publish("!homeassistant/sensor/" + deviceId + "_status/config");
+    void addCustomStateTopic(Entity &entity, String &topic) {
+        // the value template of the entity is applied to the state value
+#ifdef USTD_FEATURE_STATE_AGGREGATOR
+        if (pAggregator && pAggregator->isAggregated(entity.name)) {
+            // the individual topic may be blocked: the template gets the value of its topic
+            // from the aggregated document
+            String key = topic + "/" + entity.value;
+            json.add("stat_t", "~", pAggregator->getTopic().c_str());
+            json.add("val_tpl", "{% set value = value_json['", key.c_str(),
+                     strstr(entity.val_tpl, "value_json")
+                         ? "'] %}{% set value_json = value | from_json %}"
+                         : "'] %}",
+                     entity.val_tpl);
+            return;
+        }
+#endif
+        json.add("stat_t", "~", topic.c_str(), "/", entity.value);
+        json.add("val_tpl", entity.val_tpl);
+    }
 
-        // entity configs
-        for (unsigned int i = 0; i < entityConfigs.length(); i++) {
-            unpublishConfig(entityConfigs[i]);
+    void addStateTopic(Entity &entity, const char *topicKey, const char *templateKey,
+                       String &topic, const char *suffix, const char *filter = nullptr) {
+        // filter is the rest of a value template that transforms the state value
+#ifdef USTD_FEATURE_STATE_AGGREGATOR
+        if (pAggregator && pAggregator->isAggregated(entity.name)) {
+            json.add(topicKey, "~", pAggregator->getTopic().c_str());
+            json.add(templateKey, "{{ value_json['", (topic + "/" + suffix).c_str(), "']",
+                     filter ? filter : " }}");
+            return;
+        }
+#endif
+        json.add(topicKey, "~", topic.c_str(), "/", suffix);
+        if (filter) {
+            json.add(templateKey, "{{ value", filter);
         }
     }
 
-    void unpublishConfig(Entity &entity) {
+    void unpublishDeviceConfig() {
+        pSched->publish("!homeassistant/sensor/" + deviceId + "_status/config");
+    }
+
+    void unpublishConfig(Entity &entity, int index) {
         String entityKey = getEntityKey(entity);
         String configTopic = haTopicConfig + getDeviceClass(entity.type) + "/";
         if (entity.channel == -1) {
             pSched->publish(configTopic + entityKey + "/config");
-        } else if (entity.channel < -1) {
-            for (int channel = 0; channel < abs(entity.channel); channel++) {
-                pSched->publish(configTopic + entityKey + "_" + channel + "/config");
-            }
         } else {
-            pSched->publish(configTopic + entityKey + "_" + entity.channel + "/config");
+            int channel = entity.channel < -1 ? index : entity.channel;
+            pSched->publish(configTopic + entityKey + "_" + channel + "/config");
+        }
+    }
+
+    void invalidateAttribs() {
+        for (unsigned int i = 0; i < attribGroups.length(); i++) {
+            attribGroups[i].dirty = true;
         }
     }
 
-    void publishAttribs() {
-        JSONVar msg = JSON.parse("{}");
-        msg["RSSI"] = String(WifiGetRssiAsQuality(rssiVal));
-        msg["Signal (dBm)"] = String(rssiVal);
-        msg["Mac"] = macAddress;
-        msg["IP"] = ipAddress;
-        msg["Host"] = hostName;
+    void publishAttribs(bool force = false) {
+        // attribute groups are only rebuilt and published if an included value has changed
+        // and the minimum interval since their last publish has elapsed.
+        if (!connected || !autodiscovery) {
+            return;
+        }
+        unsigned long now = millis();
         for (unsigned int i = 0; i < attribGroups.length(); i++) {
-            msg["Manufacturer"] = attribGroups[i].manufacturer;
-            msg["Model"] = attribGroups[i].model;
-            msg["Version"] = attribGroups[i].version;
-            pSched->publish(haTopicAttrib + attribGroups[i].name, JSON.stringify(msg));
+            Attributes &att = attribGroups[i];
+            if (!force && (!att.dirty || timeDiff(att.lastPublish, now) < attribInterval)) {
+                continue;
+            }
+            att.dirty = false;
+            att.lastPublish = now;
+            publishedRssi = rssiVal;
+            json.reset();
+            json.beginObject();
+            json.add("RSSI", String(WifiGetRssiAsQuality(rssiVal)));
+            json.add("Signal (dBm)", String(rssiVal));
+            json.add("Mac", macAddress);
+            json.add("IP", ipAddress);
+            json.add("Host", hostName);
+            json.add("Manufacturer", strings.get(attribGroups[i].manufacturer));
+            json.add("Model", strings.get(attribGroups[i].model));
+            json.add("Version", strings.get(attribGroups[i].version));
+            json.endObject();
+            if (json.isValid()) {
+                pSched->publish(haTopicAttrib + strings.get(attribGroups[i].name), json.c_str());
+            }
         }
     }
 
     void unpublishAttribs() {
         for (unsigned int i = 0; i < attribGroups.length(); i++) {
-            pSched->publish(haTopicAttrib + attribGroups[i].name);
+            pSched->publish(haTopicAttrib + strings.get(attribGroups[i].name));
         }
     }
 
@@ -1006,20 +1642,15 @@ class HomeAssistant {
     void updateHA() {
         if (connected) {
             if (autodiscovery) {
-                publishAttribs();
-                publishConfigs();
+                publishAttribs(true);
+                startDiscovery(DiscoveryPublishing);
             } else {
-                unpublishConfigs();
+                startDiscovery(DiscoveryUnpublishing);
                 unpublishAttribs();
             }
         }
     }
 
-    static const char *copyfieldgetnext(const char *field, String &value) {
-        strcpy((char *)field, value.c_str());
-        return field + value.length() + 1;
-    }
-
     static int WifiGetRssiAsQuality(int rssi) {
         int quality = 0;
 
@@ -1034,6 +1665,6 @@ class HomeAssistant {
     }
 };
 
-const char *HomeAssistant::version = "0.1.0";
+const char *HomeAssistant::version = "0.2.0";
 
 }  // namespace ustd
@@ -3,6 +3,8 @@
 
 #include "scheduler.h"
 #include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
+#include "helper/output_backend.h"
 
 namespace ustd {
 
@@ -10,7 +12,8 @@ namespace ustd {
 /*! \brief mupplet-core DigitalOut class
 
 The DigitalOut class allows to integrate external relays or similar hardware
-that can be switched on or off.
+that can be switched on or off. The output can either be a GPIO port or a channel
+of an \ref OutputBackend (e.g. \ref BitAngleModulator).
 
 ## Messages
 
@@ -55,11 +58,15 @@ class DigitalOut {
   private:
     Scheduler *pSched;
     int tID;
+    MUPPLET_PROFILER
     String name;
     uint8_t port;
     bool activeLogic = false;
     const char *topic;
     bool state;
+    OutputBackend *pBackend = nullptr;
+    int8_t backendChannel = -1;
+    bool stateReplay = false;
 
   public:
     DigitalOut(String name, uint8_t port, bool activeLogic = false, const char *topic = "relay")
@@ -74,6 +81,21 @@ class DigitalOut {
          */
     }
 
+    DigitalOut(String name, OutputBackend *pBackend, int8_t backendChannel,
+               bool activeLogic = false, const char *topic = "relay")
+        : name(name), port(0), activeLogic(activeLogic), topic(topic), pBackend(pBackend),
+          backendChannel(backendChannel) {
+        /*! Instantiate a DigitalOut object on a channel of an output backend
+
+        @param name Unique name of this mupplet, appears in pub/sub messages
+        @param pBackend Pointer to the \ref OutputBackend that drives the output
+        @param backendChannel Channel number of the output on the output backend
+        @param activeLogic true: calling \ref set with true generate HIGH level (active high),
+                           false: calling \ref set with true generates LOW level (active low)
+        @param topic Topic name of the device, default value is "relay"
+         */
+    }
+
     ~DigitalOut() {
     }
 
@@ -82,16 +104,18 @@ class DigitalOut {
 
         @param _pSched Pointer to Scheduler object, used for internal task and pub/sub.
         */
+        MUPPLET_PROFILE_SETUP();
         pSched = _pSched;
-        pinMode(port, OUTPUT);
+        if (!pBackend) {
+            pinMode(port, OUTPUT);
+        }
 
         setOff();
 #if USTD_FEATURE_MEMORY > USTD_FEATURE_MEM_512B
         auto ft = [=]() { this->loop(); };
         tID = pSched->add(ft, name, 50000);
-        auto fnall = [=](String topic, String msg, String originator) {
-            this->subsMsg(topic, msg, originator);
-        };
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
+        auto fnall = msgHandler(this, &DigitalOut::subsMsg);
         pSched->subscribe(tID, name + "/" + topic + "/#", fnall);
         pSched->subscribe(tID, "mqtt/state", fnall);
         publishState();
@@ -114,21 +138,34 @@ class DigitalOut {
 #endif
     }
 
+#if defined(USTD_FEATURE_STATE_REPLAY) && USTD_FEATURE_MEMORY > USTD_FEATURE_MEM_512B
+    void registerStateReplay(StateReplay *pReplay, uint8_t priority = 128) {
+        /*! Let a \ref StateReplay coordinator republish the state after an MQTT (re-)connect
+
+        @param pReplay Pointer to the state replay coordinator
+        @param priority Replay priority: lower values are replayed first
+        */
+        if (pReplay->add([this]() { this->publishState(); }, priority) != -1) {
+            stateReplay = true;
+        }
+    }
+#endif
+
   private:
     void setOn() {
         state = true;
-        if (activeLogic) {
-            digitalWrite(port, true);
-        } else {
-            digitalWrite(port, false);
-        }
+        write(activeLogic);
     }
     void setOff() {
         state = false;
-        if (activeLogic) {
-            digitalWrite(port, false);
+        write(!activeLogic);
+    }
+    void write(bool level) {
+        if (pBackend) {
+            if (backendChannel >= 0)
+                pBackend->setChannel(backendChannel, level);
         } else {
-            digitalWrite(port, true);
+            digitalWrite(port, level);
         }
     }
 
@@ -144,18 +181,21 @@ class DigitalOut {
 
 #if USTD_FEATURE_MEMORY > USTD_FEATURE_MEM_512B
     void loop() {
+        MUPPLET_PROFILE_LOOP();
     }
 #endif
 
 #if USTD_FEATURE_MEMORY > USTD_FEATURE_MEM_512B
-    void subsMsg(String topic, String msg, String originator) {
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
         char msgbuf[128];
         memset(msgbuf, 0, 128);
         strncpy(msgbuf, msg.c_str(), 127);
-        msg.toLowerCase();
         if (topic == name + "/" + topic + "/set") {
-            set((msg == "on" || msg == "1"));
-        } else if (topic == "mqtt/state") {
+            String state = msg;
+            state.toLowerCase();
+            set((state == "on" || state == "1"));
+        } else if (topic == "mqtt/state" && !stateReplay) {
             publishState();
         }
     }
@@ -0,0 +1,357 @@
+// mup_digital_out_bank.h - muwerk digital out bank applet
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
+
+namespace ustd {
+
+#define USTD_DOB_MAX_CHANNELS (32)
+
+// clang-format off
+/*! \brief mupplet-core DigitalOutBank class
+
+The DigitalOutBank class allows to switch a group of up to 32 relays or similar hardware
+together. Unlike a set of \ref DigitalOut instances, the bank uses a single scheduler task:
+all changes that are requested within one tick are collected and applied at the end of the
+tick with one set-mask and one clear-mask register write (W1TS/W1TC) on ESP8266 (GPIO 0-15)
+and ESP32. Therefore all relays of a scene switch at the same time. On other platforms and for
+GPIOs that are not reachable via the set/clear registers, the outputs are written one by one.
+
+After the outputs have been written, the new states are published in one batch.
+
+## Messages
+
+### Messages sent by the digital out bank mupplet:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<mupplet-name>/<topic>s/state` | `0x0005` | Bitmask of the logical state of all channels, bit 0 is channel 0.
+| `<mupplet-name>/<topic>/<channel>/state` | `on`, `off` | State of a channel, only sent for channels that have changed.
+
+### Message received by the digital out bank mupplet:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<mupplet-name>/<topic>s/set` | `<mask>[,<selection>]` | Sets all channels according to the bitmask. The mask can be given as hex (`0x05`), binary (`0b101`) or decimal (`5`) value. If an optional selection mask is given, only the selected channels are changed. Invalid masks are ignored.
+| `<mupplet-name>/<topic>s/state/get` | | Sends the bitmask of all channels.
+| `<mupplet-name>/<topic>/<channel>/set` | `on`, `off`, `true`, `false` | Switches a single channel.
+| `<mupplet-name>/<topic>/<channel>/state/get` | | Sends the state of a single channel.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "mup_digital_out_bank.h"
+
+ustd::Scheduler sched;
+const uint8_t relayPorts[] = {D1, D2, D5, D6, D7};
+ustd::DigitalOutBank relays("myRelays", relayPorts, 5);
+
+void setup() {
+    relays.begin(&sched);
+}
+\endcode
+*/
+// clang-format on
+class DigitalOutBank {
+  public:
+    static const char *version;  // = "0.1.0";
+
+  private:
+    // muwerk task management
+    Scheduler *pSched;
+    int tID;
+    MUPPLET_PROFILER
+
+    // device configuration
+    String name;
+    uint8_t ports[USTD_DOB_MAX_CHANNELS];
+    uint8_t count;
+    bool activeLogic;
+    String topic;
+
+    // runtime
+    uint32_t state = 0;
+    uint32_t requestedState = 0;
+    bool stateReplay = false;
+#ifdef USTD_FEATURE_STATE_CACHE
+    StateCache *pStateCache = nullptr;
+#endif
+
+  public:
+    DigitalOutBank(String name, const uint8_t *pPorts, uint8_t count, bool activeLogic = false,
+                   const char *topic = "relay")
+        : name(name), count(count), activeLogic(activeLogic), topic(topic) {
+        /*! Instantiate a DigitalOutBank object
+
+        @param name Unique name of this mupplet, appears in pub/sub messages
+        @param pPorts Array of GPIO port numbers, the index is the channel number. The bank
+                      ends before the first port that is not supported by the platform
+                      (ESP8266: 0-16, ESP32: 0-39).
+        @param count Number of ports in pPorts (max. 32)
+        @param activeLogic true: switching a channel on generates HIGH level (active high),
+                           false: switching a channel on generates LOW level (active low)
+        @param topic Topic name of a channel, default value is "relay"
+         */
+        if (this->count > USTD_DOB_MAX_CHANNELS)
+            this->count = USTD_DOB_MAX_CHANNELS;
+        for (uint8_t i = 0; i < this->count; i++) {
+            if (!isValidPort(pPorts[i])) {
+                // the channel number is the index: no channels after an unsupported port
+                this->count = i;
+                break;
+            }
+            ports[i] = pPorts[i];
+        }
+    }
+
+    void begin(Scheduler *_pSched, uint32_t initialState = 0, unsigned long intervalUs = 10000) {
+        /*! Initialize GPIOs and start operation
+
+        @param _pSched Pointer to Scheduler object, used for internal task and pub/sub.
+        @param initialState Bitmask with the initial logical state of all channels
+        @param intervalUs Interval in microseconds in which requested changes are applied
+        */
+        MUPPLET_PROFILE_SETUP();
+        pSched = _pSched;
+        state = initialState & allMask();
+        requestedState = state;
+        for (uint8_t i = 0; i < count; i++) {
+            digitalWrite(ports[i], (bool)(state & ((uint32_t)1 << i)) == activeLogic);
+            pinMode(ports[i], OUTPUT);
+        }
+
+        auto ft = [=]() { this->loop(); };
+        tID = pSched->add(ft, name, intervalUs);
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
+        auto fnall = msgHandler(this, &DigitalOutBank::subsMsg);
+        pSched->subscribe(tID, name + "/" + topic + "/#", fnall);
+        pSched->subscribe(tID, name + "/" + topic + "s/#", fnall);
+        pSched->subscribe(tID, "mqtt/state", fnall);
+        publishState(allMask());
+    }
+
+    void set(uint8_t channel, bool on) {
+        /*! Request a new logical state for a channel
+
+        The change is applied together with all other changes at the end of the current tick.
+
+        @param channel Channel number [0 .. count-1]
+        @param on true: switch channel on, false: switch channel off
+        */
+        if (channel >= count)
+            return;
+        if (on)
+            requestedState |= (uint32_t)1 << channel;
+        else
+            requestedState &= ~((uint32_t)1 << channel);
+    }
+
+    void setMask(uint32_t mask, uint32_t selection = (uint32_t)-1) {
+        /*! Request a new logical state for several channels
+
+        The change is applied together with all other changes at the end of the current tick.
+
+        @param mask Bitmask of the new state, bit 0 is channel 0
+        @param selection Bitmask of the channels that shall be changed (default: all)
+        */
+        selection &= allMask();
+        requestedState = (requestedState & ~selection) | (mask & selection);
+    }
+
+    uint32_t getMask() {
+        /*! Get the current logical state of all channels
+        @return Bitmask of the logical state, bit 0 is channel 0
+        */
+        return state;
+    }
+
+#ifdef USTD_FEATURE_STATE_CACHE
+    void registerStateCache(StateCache *pCache) {
+        /*! Answer state requests of the output bank from a \ref StateCache
+
+        The state requests of the bank and of all channels are answered with the last
+        published values without involving the output bank.
+
+        @param pCache Pointer to the state cache
+        */
+        pCache->addTopic(name + "/" + topic + "s/state");
+        for (uint8_t i = 0; i < count; i++) {
+            pCache->addTopic(name + "/" + topic + "/" + String(i) + "/state");
+        }
+        pStateCache = pCache;
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_REPLAY
+    void registerStateReplay(StateReplay *pReplay, uint8_t priority = 128) {
+        /*! Let a \ref StateReplay coordinator republish the state after an MQTT (re-)connect
+
+        @param pReplay Pointer to the state replay coordinator
+        @param priority Replay priority: lower values are replayed first
+        */
+        if (pReplay->add([this]() { this->publishState(this->allMask()); }, priority) != -1) {
+            stateReplay = true;
+        }
+    }
+#endif
+
+  private:
+    static bool isValidPort(uint8_t port) {
+#if defined(__ESP32__)
+        return port < 40;
+#elif defined(__ESP__)
+        return port <= 16;
+#else
+        return true;
+#endif
+    }
+
+    uint32_t allMask() {
+        return count >= 32 ? (uint32_t)-1 : ((uint32_t)1 << count) - 1;
+    }
+
+    void apply() {
+        uint32_t changed = state ^ requestedState;
+        if (!changed)
+            return;
+        // collect the physical levels of all changed channels in set/clear register masks
+        uint32_t setMask = 0, clrMask = 0;
+#if defined(__ESP32__)
+        uint32_t setMask1 = 0, clrMask1 = 0;
+#elif defined(__ESP__)
+        int8_t level16 = -1;  // GPIO16 is not part of the GPIO registers
+#endif
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t bit = (uint32_t)1 << i;
+            if (!(changed & bit))
+                continue;
+            bool level = (bool)(requestedState & bit) == activeLogic;
+#if defined(__ESP32__)
+            if (ports[i] < 32) {
+                (level ? setMask : clrMask) |= (uint32_t)1 << ports[i];
+            } else {
+                (level ? setMask1 : clrMask1) |= (uint32_t)1 << (ports[i] - 32);
+            }
+#elif defined(__ESP__)
+            if (ports[i] < 16) {
+                (level ? setMask : clrMask) |= (uint32_t)1 << ports[i];
+            } else {
+                level16 = level;  // only GPIO16 passes isValidPort()
+            }
+#else
+            digitalWrite(ports[i], level);
+#endif
+        }
+#if defined(__ESP32__)
+        REG_WRITE(GPIO_OUT_W1TS_REG, setMask);
+        REG_WRITE(GPIO_OUT_W1TC_REG, clrMask);
+        if (setMask1 || clrMask1) {
+            REG_WRITE(GPIO_OUT1_W1TS_REG, setMask1);
+            REG_WRITE(GPIO_OUT1_W1TC_REG, clrMask1);
+        }
+#elif defined(__ESP__)
+        GPOS = setMask;
+        GPOC = clrMask;
+        if (level16 != -1) {
+            // written right after the registers to keep the skew to the other outputs small
+            digitalWrite(16, level16);
+        }
+#endif
+        state = requestedState;
+        publishState(changed);
+    }
+
+    void publishState(uint32_t changed) {
+        char buf[16];
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t bit = (uint32_t)1 << i;
+            if (changed & bit) {
+                pSched->publish(name + "/" + topic + "/" + String(i) + "/state",
+                                (state & bit) ? "on" : "off");
+            }
+        }
+        buf[0] = '0';
+        buf[1] = 'x';
+        formatHex(buf + 2, state, (count + 3) / 4);
+        pSched->publish(name + "/" + topic + "s/state", buf);
+    }
+
+    static bool parseMask(String arg, uint32_t &mask) {
+        arg.trim();
+        arg.toLowerCase();
+        const char *p = arg.c_str();
+        int base = 10;
+        if (arg.startsWith("0x")) {
+            p += 2;
+            base = 16;
+        } else if (arg.startsWith("0b")) {
+            p += 2;
+            base = 2;
+        }
+        if (!isalnum(*p)) {
+            return false;  // no sign or whitespace
+        }
+        char *end;
+        mask = strtoul(p, &end, base);
+        return end != p && *end == '\0';
+    }
+
+    void loop() {
+        MUPPLET_PROFILE_LOOP();
+        apply();
+    }
+
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
+#ifdef USTD_FEATURE_STATE_CACHE
+        if (pStateCache && pStateCache->answer(topic)) {
+            return;
+        }
+#endif
+        String leader = name + "/" + this->topic + "/";
+        if (topic == name + "/" + this->topic + "s/set") {
+            uint32_t mask, selection = (uint32_t)-1;
+            int ind = msg.indexOf(',');
+            if (ind == -1) {
+                if (parseMask(msg, mask)) {
+                    setMask(mask);
+                }
+            } else if (parseMask(msg.substring(0, ind), mask) &&
+                       parseMask(msg.substring(ind + 1), selection)) {
+                setMask(mask, selection);
+            }
+        } else if (topic == name + "/" + this->topic + "s/state/get") {
+            publishState(0);
+        } else if (topic.startsWith(leader)) {
+            String sub = topic.substring(leader.length());
+            int ind = sub.indexOf('/');
+            if (ind == -1) {
+                return;
+            }
+            long channel = parseLong(sub.substring(0, ind), -1);
+            if (channel < 0 || channel >= count) {
+                return;
+            }
+            sub = sub.substring(ind + 1);
+            if (sub == "set") {
+                int8_t on = parseBoolean(msg);
+                if (on != -1) {
+                    set(channel, on);
+                }
+            } else if (sub == "state/get") {
+                pSched->publish(leader + String(channel) + "/state",
+                                (state & ((uint32_t)1 << channel)) ? "on" : "off");
+            }
+        } else if (topic == "mqtt/state" && msg == "connected" && !stateReplay) {
+            publishState(allMask());
+        }
+    }
+};  // DigitalOutBank
+
+const char *DigitalOutBank::version = "0.1.0";
+
+}  // namespace ustd
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
 
 namespace ustd {
 
@@ -150,6 +152,7 @@ class FrequencyCounter {
   private:
     Scheduler *pSched;
     int tID;
+    MUPPLET_PROFILER
 
     String name;
     uint8_t pin_input;
@@ -239,6 +242,7 @@ class FrequencyCounter {
         @param scheduleUs Measurement schedule in microseconds
         @return true if successful
         */
+        MUPPLET_PROFILE_SETUP();
         pSched = _pSched;
 
         pinMode(pin_input, INPUT_PULLUP);
@@ -266,10 +270,9 @@ class FrequencyCounter {
 
         auto ft = [=]() { this->loop(); };
         tID = pSched->add(ft, name, scheduleUs);  // uS schedule
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
 
-        auto fnall = [=](String topic, String msg, String originator) {
-            this->subsMsg(topic, msg, originator);
-        };
+        auto fnall = msgHandler(this, &FrequencyCounter::subsMsg);
         pSched->subscribe(tID, name + "/#", fnall);
         return true;
     }
@@ -300,11 +303,8 @@ class FrequencyCounter {
 
     void publish_frequency() {
         char buf[32];
-        sprintf(buf, "%10.3f", inputFrequencyVal);
-        char *p1 = buf;
-        while (*p1 == ' ')
-            ++p1;
-        pSched->publish(name + "/sensor/frequency", p1);
+        formatFixed(buf, inputFrequencyVal, 3);
+        pSched->publish(name + "/sensor/frequency", buf);
     }
 
     void publish() {
@@ -312,6 +312,7 @@ class FrequencyCounter {
     }
 
     void loop() {
+        MUPPLET_PROFILE_LOOP();
         double freq = getFqResetpIrqFrequency(interruptIndex_input, 0) * frequencyRenormalisation;
         if (detectZeroChange) {
             if ((frequency.lastVal == 0.0 && freq > 0.0) ||
@@ -326,7 +327,8 @@ class FrequencyCounter {
         }
     }
 
-    void subsMsg(String topic, String msg, String originator) {
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
         if (topic == name + "/sensor/state/get") {
             publish();
         } else if (topic == name + "/sensor/frequency/get") {
@@ -3,6 +3,8 @@
 #pragma once
 
 #include "helper/light_controller.h"
+#include "helper/output_backend.h"
+#include "helper/mupplet_profiler.h"
 #include "scheduler.h"
 
 namespace ustd {
@@ -62,6 +64,7 @@ class Light {
     // muwerk task management
     Scheduler *pSched;
     int tID;
+    MUPPLET_PROFILER
 
     // device configuration
     String name;
@@ -71,6 +74,23 @@ class Light {
     bool activeLogic = false;
     uint16_t pwmrange;
     uint8_t channel;
+    OutputBackend *pBackend = nullptr;
+    int8_t backendChannel = -1;
+#ifdef USTD_FEATURE_STATE_CACHE
+    StateCache *pStateCache = nullptr;
+    bool cacheStale = false;
+#endif
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    typedef struct {
+        uint32_t interval;  // ms
+        uint16_t level;     // brightness level [0..65535]
+        uint8_t state;
+        uint8_t mode;   // LightController::Mode
+        uint8_t phase;  // [0..255]
+        uint8_t reserved[3];
+    } Snapshot;
+    StateSnapshot *pSnapshot = nullptr;
+#endif
 
   public:
     LightController light;
@@ -95,6 +115,25 @@ class Light {
         */
     }
 
+    Light(String name, OutputBackend *pBackend, int8_t backendChannel, bool activeLogic = false)
+        : name(name), port(0), activeLogic(activeLogic), channel(0), pBackend(pBackend),
+          backendChannel(backendChannel) {
+        /*! Instantiate a Led object on a channel of an \ref OutputBackend
+
+        No hardware interaction is performed, until \ref begin() is called.
+
+        @param name Name of the led, used to reference it by pub/sub messages
+        @param pBackend Pointer to the output backend that drives the led (e.g. a
+                        \ref BitAngleModulator). If the backend is not dimmable, the led
+                        is switched on for all brightness levels above 0.5.
+        @param backendChannel Channel number of the led on the output backend.
+        @param activeLogic Characterizes the pysical logicl-level which would turn
+                           the led on. Default is 'false', which assumes the led
+                           turns on if logic level at the output is LOW. Change
+                           to 'true', if led is turned on by physical logic level HIGH.
+        */
+    }
+
     /** Initialize GPIO hardware and start operation
      *
      * @param _pSched Pointer to a muwerk scheduler object, used to create worker tasks and for
@@ -106,25 +145,42 @@ class Light {
      *                     `activeLogic` parameter.
      */
     void begin(Scheduler *_pSched, bool initialState = false) {
+        MUPPLET_PROFILE_SETUP();
         pSched = _pSched;
-        tID = pSched->add([this]() { this->light.loop(); }, name, 50000L);
-
-        pSched->subscribe(tID, name + "/light/#", [this](String topic, String msg, String orig) {
+        tID = pSched->add(
+            [this]() {
+                MUPPLET_PROFILE_LOOP();
+                this->light.loop();
+            },
+            name, 50000L);
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
+
+        pSched->subscribe(tID, name + "/light/#", [this](const String &topic, const String &msg,
+                                                         const String &orig) {
+            MUPPLET_PROFILE_MSG(topic);
+#ifdef USTD_FEATURE_STATE_CACHE
+            if (pStateCache && pStateCache->answer(topic)) {
+                return;
+            }
+#endif
             this->light.commandParser(topic.substring(name.length() + 7), msg);
+            this->saveSnapshot();
         });
 
-        // prepare hardware
+        // prepare hardware (a channel of an output backend is driven by the backend)
+        if (!pBackend) {
 #if defined(__ESP32__)
-        pinMode(port, OUTPUT);
+            pinMode(port, OUTPUT);
 // use first channel of 16 channels (started from zero)
 #define LEDC_TIMER_BITS 10
 // use 5000 Hz as a LEDC base frequency
 #define LEDC_BASE_FREQ 5000
-        ledcSetup(channel, LEDC_BASE_FREQ, LEDC_TIMER_BITS);
-        ledcAttachPin(port, channel);
+            ledcSetup(channel, LEDC_BASE_FREQ, LEDC_TIMER_BITS);
+            ledcAttachPin(port, channel);
 #else
-        pinMode(port, OUTPUT);
+            pinMode(port, OUTPUT);
 #endif
+        }
 #ifdef __ESP__
         pwmrange = 1023;
 #else
@@ -132,9 +188,21 @@ class Light {
 #endif
 
         // start light controller
-        light.begin([this](bool state, double level, bool control,
-                           bool notify) { this->onLightControl(state, level, control, notify); },
-                    initialState);
+        auto fc = [this](bool state, double level, bool control, bool notify) {
+            this->onLightControl(state, level, control, notify);
+        };
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        Snapshot snap;
+        if (pSnapshot && pSnapshot->restore(name, &snap, sizeof(snap))) {
+            light.begin(fc, snap.state, (double)snap.level / 65535.0);
+            if (snap.mode == LightController::Blink || snap.mode == LightController::Wave) {
+                light.setMode((LightController::Mode)snap.mode, snap.interval,
+                              (double)snap.phase / 255.0);
+            }
+            return;
+        }
+#endif
+        light.begin(fc, initialState);
     }
 
     /** Set light to a given logical state.
@@ -162,6 +230,7 @@ class Light {
     void setMode(LightController::Mode mode, unsigned int interval_ms = 1000,
                  double phase_unit = 0.0, String pattern = "") {
         light.setMode(mode, interval_ms, phase_unit, pattern);
+        saveSnapshot();
     }
 
     /** Set minimum and maximum brightness in wave \ref LightController::Mode
@@ -190,9 +259,65 @@ class Light {
                         icon, attribs);
     }
 #endif
+
+#ifdef USTD_FEATURE_STATE_REPLAY
+    /** Let a \ref StateReplay coordinator publish the state after an MQTT (re-)connect
+     * @param pReplay Pointer to the state replay coordinator
+     * @param priority Replay priority: lower values are replayed first
+     */
+    void registerStateReplay(StateReplay *pReplay, uint8_t priority = 128) {
+        pReplay->add([this]() { this->light.commandParser("unitbrightness/get", ""); }, priority);
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    /** Restore the state of the light from a \ref StateSnapshot after a reboot
+     *
+     * Brightness and blink or wave mode are saved on every change and restored by \ref begin()
+     * before the hardware is set for the first time. **Must** be called before \ref begin().
+     * @param pSnapshot Pointer to the state snapshot
+     */
+    void registerStateSnapshot(StateSnapshot *pSnapshot) {
+        this->pSnapshot = pSnapshot;
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_CACHE
+    /** Answer state requests of the light from a \ref StateCache
+     *
+     * `unitbrightness/get` is answered with the last published brightness and state without
+     * involving the light controller. While an automatic mode changes the light without
+     * notification, requests are answered by the light controller.
+     * @param pCache Pointer to the state cache
+     */
+    void registerStateCache(StateCache *pCache) {
+        pCache->addTopic(name + "/light/unitbrightness", name + "/light/unitbrightness/get");
+        pCache->addTopic(name + "/light/state", name + "/light/unitbrightness/get");
+        pStateCache = pCache;
+    }
+#endif
   private:
+    void saveSnapshot() {
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        if (pSnapshot) {
+            Snapshot snap = {(uint32_t)light.getInterval(),
+                             (uint16_t)(light.getBrightness() * 65535.0 + 0.5),
+                             light.getState(),
+                             (uint8_t)light.getMode(),
+                             (uint8_t)(light.getPhase() * 255.0 + 0.5),
+                             {0, 0, 0}};
+            pSnapshot->update(name, &snap, sizeof(snap));
+        }
+#endif
+    }
+
     void onLightControl(bool state, double level, bool control, bool notify) {
-        if (control) {
+        if (control && pBackend) {
+            if (backendChannel >= 0) {
+                double out = state ? level : 0.0;
+                pBackend->setChannelLevel(backendChannel, activeLogic ? out : 1.0 - out);
+            }
+        } else if (control) {
             if (state && level == 1.0) {
                 // led is on at maximum brightness
 #ifdef __ESP32__
@@ -224,15 +349,21 @@ class Light {
 #endif
             }
         }
+#ifdef USTD_FEATURE_STATE_CACHE
+        if (pStateCache) {
+            // automatic modes change the light without publishing it
+            if (!notify && !cacheStale) {
+                pStateCache->invalidate(name);
+            }
+            cacheStale = !notify;
+        }
+#endif
         if (notify) {
-#ifdef __ARDUINO__
-            pSched->publish(name + "/light/unitbrightness", String(level, 3));
-#else
             char buf[32];
-            sprintf(buf, "%5.3f", level);
+            formatFixed(buf, level, 3);
             pSched->publish(name + "/light/unitbrightness", buf);
-#endif
             pSched->publish(name + "/light/state", state ? "on" : "off");
+            saveSnapshot();
         }
     }
 };
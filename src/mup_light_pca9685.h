@@ -3,6 +3,7 @@
 
 #include "muwerk.h"
 #include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
 #include "helper/light_controller.h"
 #include <Adafruit_PWMServoDriver.h>
 
@@ -63,6 +64,7 @@ class LightsPCA9685 {
     // muwerk task management
     Scheduler *pSched;
     int tID;
+    MUPPLET_PROFILER
 
     // device configuration
     String name;
@@ -74,6 +76,10 @@ class LightsPCA9685 {
     // runtime
     LightController light[16];
     bool activeLogic;
+#ifdef USTD_FEATURE_STATE_CACHE
+    StateCache *pStateCache = nullptr;
+    uint16_t cacheStale = 0;  // bitmask of channels changed without notification
+#endif
 
   public:
     /** Instantiate a PCA9685 16 channel light object at a given address.
@@ -104,9 +110,11 @@ class LightsPCA9685 {
      *                     'activeLogic' parameter.
      */
     void begin(Scheduler *_pSched, TwoWire *_pWire = nullptr, bool initialState = false) {
+        MUPPLET_PROFILE_SETUP();
         // standard muwerk task initialization
         pSched = _pSched;
         tID = pSched->add([this]() { this->loop(); }, name, 80000L);
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
 
         // initialize hardware
         pPwm = new Adafruit_PWMServoDriver(addr, _pWire == nullptr ? Wire : *_pWire);
@@ -114,19 +122,26 @@ class LightsPCA9685 {
         pPwm->setPWMFreq(1000);
 
         // subscribe to light messages and pass to light controller
-        pSched->subscribe(tID, name + "/light/#", [this](String topic, String msg, String orig) {
-            topic = topic.substring(name.length() + 7);
-            int iPos = topic.indexOf('/');
+        pSched->subscribe(tID, name + "/light/#", [this](const String &topic, const String &msg,
+                                                         const String &orig) {
+            MUPPLET_PROFILE_MSG(topic);
+#ifdef USTD_FEATURE_STATE_CACHE
+            if (pStateCache && pStateCache->answer(topic)) {
+                return;
+            }
+#endif
+            String command = topic.substring(name.length() + 7);
+            int iPos = command.indexOf('/');
             if (iPos == -1) {
                 // invalid topic
                 return;
             }
-            long index = ustd::parseLong(topic.substring(0, iPos), -1);
+            long index = ustd::parseLong(command.substring(0, iPos), -1);
             if (index < 0 || index > 15) {
                 // invalid topic
                 return;
             }
-            this->light[index].commandParser(topic.substring(iPos + 1), msg);
+            this->light[index].commandParser(command.substring(iPos + 1), msg);
         });
 
         // start light controller (register hardware implementation)
@@ -227,8 +242,45 @@ class LightsPCA9685 {
     }
 #endif
 
+#ifdef USTD_FEATURE_STATE_REPLAY
+    /** Let a \ref StateReplay coordinator publish the state of all channels after an MQTT
+     * (re-)connect. Each channel is replayed separately, so that the 32 messages are spread
+     * over several scheduler cycles.
+     * @param pReplay Pointer to the state replay coordinator
+     * @param priority Replay priority: lower values are replayed first
+     */
+    void registerStateReplay(StateReplay *pReplay, uint8_t priority = 128) {
+        for (uint8_t channel = 0; channel < 16; channel++) {
+            pReplay->add(
+                [this, channel]() {
+                    this->light[channel].commandParser("unitbrightness/get", "");
+                },
+                priority);
+        }
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_CACHE
+    /** Answer state requests of the lights from a \ref StateCache
+     *
+     * `<channel>/unitbrightness/get` is answered with the last published brightness and state
+     * of the channel without involving the light controller. While an automatic mode changes a
+     * channel without notification, its requests are answered by the light controller.
+     * @param pCache Pointer to the state cache
+     */
+    void registerStateCache(StateCache *pCache) {
+        for (int channel = 0; channel < 16; channel++) {
+            String prefix = name + "/light/" + String(channel);
+            pCache->addTopic(prefix + "/unitbrightness", prefix + "/unitbrightness/get");
+            pCache->addTopic(prefix + "/state", prefix + "/unitbrightness/get");
+        }
+        pStateCache = pCache;
+    }
+#endif
+
   private:
     void loop() {
+        MUPPLET_PROFILE_LOOP();
         for (int channel = 0; channel < 16; channel++) {
             light[channel].loop();
         }
@@ -248,9 +300,22 @@ class LightsPCA9685 {
                 pwmSet(channel, intensity);
             }
         }
+#ifdef USTD_FEATURE_STATE_CACHE
+        if (pStateCache) {
+            // automatic modes change the channel without publishing it
+            uint16_t bit = (uint16_t)1 << channel;
+            if (!notify && !(cacheStale & bit)) {
+                pStateCache->invalidate(name + "/light/" + String(channel));
+                cacheStale |= bit;
+            } else if (notify) {
+                cacheStale &= ~bit;
+            }
+        }
+#endif
         if (notify) {
-            pSched->publish(name + "/light/" + String(channel) + "/unitbrightness",
-                            String(level, 3));
+            char buf[32];
+            formatFixed(buf, level, 3);
+            pSched->publish(name + "/light/" + String(channel) + "/unitbrightness", buf);
             pSched->publish(name + "/light/" + String(channel) + "/state", state ? "on" : "off");
         }
     }
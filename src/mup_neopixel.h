@@ -3,7 +3,9 @@
 #include "ustd_array.h"
 #include "scheduler.h"
 #include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
 #include "helper/mup_astro.h"
+#include "helper/publish_filter.h"
 #include "Adafruit_NeoPixel.h"
 
 namespace ustd {
@@ -266,6 +268,7 @@ class NeoPixel {
     String NEOPIXEL_VERSION = "0.1.0";
     Scheduler *pSched;
     int tID;
+    MUPPLET_PROFILER
     String name;
     bool bStarted = false;
     uint8_t pin;
@@ -285,6 +288,21 @@ class NeoPixel {
     SpecialEffects *pEffects = nullptr;
     bool isFirstLoop = true;
     bool scheduled = false;
+    bool stateReplay = false;
+    PublishFilter publisher;
+#ifdef USTD_FEATURE_STATE_CACHE
+    StateCache *pStateCache = nullptr;
+    bool cacheStale = false;
+#endif
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    typedef struct {
+        uint16_t level;  // unit brightness [0..65535]
+        uint8_t effect;  // SpecialEffects::EffectType
+        uint8_t r, g, b;
+        uint8_t reserved[2];
+    } Snapshot;
+    StateSnapshot *pSnapshot = nullptr;
+#endif
     int startHour, endHour, startMin, endMin;
 
     NeoPixel(String name, uint8_t pin, uint16_t numRows = 1, uint16_t numCols = 1,
@@ -300,7 +318,9 @@ class NeoPixel {
     }
 
     void begin(Scheduler *_pSched) {
+        MUPPLET_PROFILE_SETUP();
         pSched = _pSched;
+        publisher.begin(pSched);
 
         pPixels = new Adafruit_NeoPixel(numPixels, pin, options);
         phwBuf = new ustd::array<uint32_t>(numPixels, numPixels);
@@ -312,12 +332,26 @@ class NeoPixel {
         pPixels->begin();
         auto ft = [=]() { this->loop(); };
         tID = pSched->add(ft, name, 50000);
-        auto fnall = [=](String topic, String msg, String originator) {
-            this->subsMsg(topic, msg, originator);
-        };
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
+        auto fnall = msgHandler(this, &NeoPixel::subsMsg);
         pSched->subscribe(tID, name + "/light/#", fnall);
         pSched->subscribe(tID, "mqtt/state", fnall);
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        Snapshot snap;
+        if (pSnapshot && pSnapshot->restore(name, &snap, sizeof(snap)) &&
+            snap.effect < SpecialEffects::effectCount) {
+            setEffect((SpecialEffects::EffectType)snap.effect, true);
+            // restore color and brightness instead of the presets of the first effect loop,
+            // animated effects continue from the restored color
+            color(snap.r, snap.g, snap.b, false, false);
+            brightness((double)snap.level / 65535.0, true, false);
+            isFirstLoop = false;
+        } else {
+            setEffect(SpecialEffects::EffectType::Default, true);
+        }
+#else
         setEffect(SpecialEffects::EffectType::Default, true);
+#endif
         publishState();
         publishColor();
         bStarted = true;
@@ -345,6 +379,7 @@ class NeoPixel {
             effectType = _type;
             isFirstLoop = true;
             publishEffect();
+            saveSnapshot();
         }
     }
 
@@ -411,9 +446,19 @@ class NeoPixel {
             state = true;
         else
             state = false;
+#ifdef USTD_FEATURE_STATE_CACHE
+        if (pStateCache) {
+            // effects change the pixels without publishing them
+            if (!notify && !cacheStale) {
+                pStateCache->invalidate(name);
+            }
+            cacheStale = !notify;
+        }
+#endif
         if (notify) {
             publishState();
             publishColor();
+            saveSnapshot();
         }
     }
 
@@ -439,43 +484,129 @@ class NeoPixel {
         }
     }
 
-    void publishBrightness() {
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    void registerStateSnapshot(StateSnapshot *pSnapshot) {
+        /*! Restore the state of the light from a \ref StateSnapshot after a reboot
+
+        Effect, brightness and color are saved on every change and restored by \ref begin()
+        before the pixels are set for the first time. **Must** be called before \ref begin().
+
+        @param pSnapshot Pointer to the state snapshot
+        */
+        this->pSnapshot = pSnapshot;
+    }
+#endif
+
+    void setPublishFilter(bool suppressDuplicates, unsigned long coalesceMs = 0) {
+        /*! Configure the filter for state messages (see \ref PublishFilter)
+
+        By default, state, brightness, effect and color messages are only published if their
+        value changed. Answers to `get` requests and the state replay after an MQTT connect are
+        always published.
+
+        @param suppressDuplicates If `true` (default), messages with an unchanged value are not
+                                  published
+        @param coalesceMs Coalescing window in ms: rapid changes of a topic are published at most
+                          once per window with the last value, 0 (default) publishes immediately
+        */
+        publisher.configure(suppressDuplicates, coalesceMs);
+    }
+
+#ifdef USTD_FEATURE_STATE_CACHE
+    void registerStateCache(StateCache *pCache) {
+        /*! Answer state requests of the light from a \ref StateCache
+
+        The requests for state (answered with state, brightness and effect), brightness and
+        color are answered with the last published values without involving the light. While an
+        effect changes the pixels without notification, requests are answered by the light.
+
+        @param pCache Pointer to the state cache
+        */
+        String request = name + "/light/state/get";
+        pCache->addTopic(name + "/light/state", request);
+        pCache->addTopic(name + "/light/unitbrightness", request);
+        pCache->addTopic(name + "/light/effect", request);
+        pCache->addTopic(name + "/light/unitbrightness");
+        pCache->addTopic(name + "/light/color");
+        pStateCache = pCache;
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_REPLAY
+    void registerStateReplay(StateReplay *pReplay, uint8_t priority = 128) {
+        /*! Let a \ref StateReplay coordinator republish the state after an MQTT (re-)connect
+
+        @param pReplay Pointer to the state replay coordinator
+        @param priority Replay priority: lower values are replayed first
+        */
+        if (pReplay->add(
+                [this]() {
+                    this->publishState(true);
+                    this->publishColor(-1, true);
+                },
+                priority) != -1) {
+            stateReplay = true;
+        }
+    }
+#endif
+
+    void saveSnapshot() {
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        if (pSnapshot && bStarted) {  // not during begin(): the snapshot is restored there
+            Snapshot snap = {(uint16_t)(unitBrightness * 65535.0 + 0.5),
+                             (uint8_t)effectType, gr, gg, gb, {0, 0}};
+            pSnapshot->update(name, &snap, sizeof(snap));
+        }
+#endif
+    }
+
+    static void formatColor(char *buf, uint8_t r, uint8_t g, uint8_t b) {
+        buf += formatUnsignedLong(buf, r);
+        *buf++ = ',';
+        buf += formatUnsignedLong(buf, g);
+        *buf++ = ',';
+        formatUnsignedLong(buf, b);
+    }
+
+    void publishBrightness(bool force = false) {
         char buf[32];
-        sprintf(buf, "%5.3f", unitBrightness);
-        pSched->publish(name + "/light/unitbrightness", buf);
+        formatFixed(buf, unitBrightness, 3);
+        publisher.publish(name + "/light/unitbrightness", buf, force);
     }
 
-    void publishColor(int16_t index = -1) {
+    void publishColor(int16_t index = -1, bool force = false) {
         char buf[64];
         if (index == -1) {
-            sprintf(buf, "%d,%d,%d", gr, gg, gb);
-            pSched->publish(name + "/light/color", buf);
+            formatColor(buf, gr, gg, gb);
+            publisher.publish(name + "/light/color", buf, force);
         } else {
             uint8_t r, g, b;
             RGB32Parse((*phwBuf)[index], &r, &g, &b);
-            sprintf(buf, "%d,%d,%d", r, g, b);
-            pSched->publish(name + "/light/" + String(index) + "/color", buf);
+            formatColor(buf, r, g, b);
+            publisher.publish(name + "/light/" + String(index) + "/color", buf, force);
         }
     }
 
-    void publishEffect() {
+    void publishEffect(bool force = false) {
         String nameE = SpecialEffects::effectName[(int)effectType];
-        pSched->publish(name + "/light/effect", nameE);
+        publisher.publish(name + "/light/effect", nameE, force);
     }
 
-    void publishState() {
+    void publishState(bool force = false) {
         if (state) {
-            pSched->publish(name + "/light/state", "on");
+            publisher.publish(name + "/light/state", "on", force);
             this->state = true;
         } else {
-            pSched->publish(name + "/light/state", "off");
+            publisher.publish(name + "/light/state", "off", force);
             this->state = false;
         }
-        publishBrightness();
-        publishEffect();
+        publishBrightness(force);
+        publishEffect(force);
     }
 
     void loop() {
+        MUPPLET_PROFILE_LOOP();
+        publisher.loop();
         if (bStarted) {
             ++ticker;
             switch (effectType) {
@@ -555,20 +686,28 @@ class NeoPixel {
         }
     }
 
-    void subsMsg(String topic, String msg, String originator) {
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
+#ifdef USTD_FEATURE_STATE_CACHE
+        // a pending coalesced value is newer than the cache: answer with a forced publish
+        if (pStateCache && !publisher.hasPending() && pStateCache->answer(topic)) {
+            return;
+        }
+#endif
         uint8_t r, g, b;
         String leader = name + "/light/";
         if (topic == name + "/light/state/get") {
-            publishState();
+            publishState(true);
         } else if (topic == name + "/light/unitbrightness/get") {
-            publishBrightness();
+            publishBrightness(true);
         } else if (topic == name + "/light/color/get") {
-            publishColor(-1);
+            publishColor(-1, true);
         } else if (topic == name + "/light/set" || topic == name + "/light/state/set" || topic == name + "/light/unitbrightness/set") {
             // if (ticker - lastTicker < 6) return;  // ignore anything that follows too "fast" after color-sets.
             bool ab;
-            msg.toLowerCase();
-            if (msg == "on" || msg == "true")
+            String state = msg;
+            state.toLowerCase();
+            if (state == "on" || state == "true")
                 ab = true;
             else
                 ab = false;
@@ -614,13 +753,13 @@ class NeoPixel {
                         }
                     }
                     if (cmd == "color/get") {
-                        publishColor(index);
+                        publishColor(index, true);
                     }
                 }
             }
-        } else if (topic == "mqtt/state" && msg == "connected") {
-            publishState();
-            publishColor();
+        } else if (topic == "mqtt/state" && msg == "connected" && !stateReplay) {
+            publishState(true);
+            publishColor(-1, true);
         }
     }
 };  // NeoPixel
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
 
 namespace ustd {
 
@@ -28,7 +30,19 @@ volatile uint16_t crc[USTD_MAX_RNG_PIRQS] = {0xffff, 0xffff, 0xffff, 0xffff, 0xf
 volatile unsigned long irq_count_total = 0;
 
 volatile unsigned long d_hist[256];
-volatile const int maxBits = 3;
+
+// Number of low bits of each delta that are fed into the von Neumann extractor. The value is
+// adapted by the Rng instance to the measured per-sample min-entropy of the random device.
+volatile uint8_t maxBits[USTD_MAX_RNG_PIRQS] = {3, 3, 3, 3, 3, 3, 3, 3, 3, 3};
+
+// Histogram of the low byte of the time interval between two interrupts. It is used to estimate
+// the min-entropy per sample of the random device. Only one interrupt (the one claimed via
+// entropy_estimate_irq) is sampled at a time, all other instances keep their current maxBits.
+#define USTD_RNG_ENTROPY_WINDOW (4096)
+volatile int8_t entropy_estimate_irq = -1;
+volatile unsigned long last_irq_us[USTD_MAX_RNG_PIRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+volatile uint16_t raw_hist[256];
+volatile uint16_t raw_hist_count = 0;
 
 // This interrupt is triggered by the random device connected to the MCU at random time intervals.
 void G_INT_ATTR ustd_rng_pirq_master(uint8_t irqno) {
@@ -37,6 +51,13 @@ void G_INT_ATTR ustd_rng_pirq_master(uint8_t irqno) {
     irq_count_total++;
     uint8_t i;
     uint8_t delta;
+    if (irqno == entropy_estimate_irq) {
+        if (raw_hist_count < USTD_RNG_ENTROPY_WINDOW) {
+            raw_hist[(uint8_t)((curr - last_irq_us[irqno]) & 0xff)]++;
+            raw_hist_count++;
+        }
+    }
+    last_irq_us[irqno] = curr;
     if (entropy_pool_size[irqno] < USTD_ENTROPY_POOL_SIZE) {
         // CRC16 CCITT bit shuffle, input is 16 bits of micros() timer,
         // current time is determined by the chaotic behavior of the random
@@ -65,7 +86,8 @@ void G_INT_ATTR ustd_rng_pirq_master(uint8_t irqno) {
         // only use maxBits bits of delta, the value of maxBits is determined by the
         // by the 'speed' of the random device that generates the interrupt and the
         // mcu speed. Slower devices should use less bits, faster devices can use more.
-        for (int i = 0; i < maxBits; i++) {
+        // maxBits is adapted by Rng::estimateEntropy() to the measured min-entropy.
+        for (int i = 0; i < maxBits[irqno]; i++) {
             uint8_t curBit = (delta >> i) & 0x01;
             // von Neumann extractor
             if (bit_cnt[irqno] == 0) {
@@ -152,6 +174,18 @@ void get_d_hist(unsigned long *pHistBuf) {
     interrupts();
 }
 
+unsigned long getRawHistogram(uint16_t *pHistBuf) {
+    noInterrupts();
+    unsigned long n = raw_hist_count;
+    for (int i = 0; i < 256; i++) {
+        pHistBuf[i] = raw_hist[i];
+        raw_hist[i] = 0;
+    }
+    raw_hist_count = 0;
+    interrupts();
+    return n;
+}
+
 unsigned long getTotalIrqCount() {
     noInterrupts();
     unsigned long irqs = irq_count_total;
@@ -164,6 +198,12 @@ unsigned long getTotalIrqCount() {
 
 TBD.
 
+The number of bits used of each sample of the random device is adapted automatically: the
+mupplet estimates the min-entropy per sample (most common value estimate with an upper
+confidence bound, see NIST SP 800-90B) from the distribution of the time intervals between
+interrupts, both during self-test and continuously afterwards. The number of bits is the
+integer part of the estimate (1 to 8 bits). Use \ref setMaxBits to set a fixed value instead.
+
 ## Messages
 
 ### Messages sent by the switch mupplet:
@@ -172,6 +212,8 @@ TBD.
 | ----- | ------------ | -------
 | `<mupplet-name>/rng/data` | up to 128 bytes encoded as hex (256 chars) of random data | If no random data is available, no message is sent. It not enough data is available, the message is sent with the available data. |
 | `<mupplet-name>/rng/state` | `none`, `self-test`, `ok`, `failed` | State of the RNG. `none` means rng is not started, `self-test` means the RNG is in self-test mode, `ok` means the RNG is operational, `failed` means the RNG failed the self-test, indicating a hardware problem with the RNG. |
+| `<mupplet-name>/rng/state/maxbits` | `1` .. `8` | Number of bits used of each sample of the random device. |
+| `<mupplet-name>/rng/state/entropy` | `5.73` | Estimated min-entropy per sample in bits, `NaN` if no estimate is available yet. |
 ### Message received by the switch mupplet:
 
 | topic | message body | comment
@@ -187,10 +229,11 @@ class Rng {
                          IM_FALLING, /*!< trigger on falling signal */
                          IM_CHANGE  /*!< trigger on both rising and falling signal */
                          };
-    String RNG_VERSION = "0.1.1";
+    String RNG_VERSION = "0.1.2";
   private:
     Scheduler *pSched;
     int tID;
+    MUPPLET_PROFILER
 
     enum RngSampleMode {RSM_NONE, RSM_SELF_TEST, RSM_OK, RSM_FAILED};
     RngSampleMode rngSampleMode = RSM_NONE;
@@ -211,6 +254,8 @@ class Rng {
     unsigned long lastOkMillis = 0;
     unsigned long lastIrqCount = 0;
     bool publishViaSerial = false;
+    bool adaptiveMaxBits = true;
+    double entropyEstimate = -1.0;
   public:
 
     Rng(String name, uint8_t pin_input, int8_t interruptIndex_input,
@@ -249,6 +294,7 @@ class Rng {
         @param scheduleUs Measurement schedule in microseconds
         @return true if successful
         */
+        MUPPLET_PROFILE_SETUP();
         pSched = _pSched;
         publishViaSerial = _publishViaSerial;
         if (rngStateLedPin >= 0) {
@@ -276,11 +322,13 @@ class Rng {
 
         auto ft = [=]() { this->loop(); };
         tID = pSched->add(ft, name, scheduleUs);  // uS schedule
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
 
-        auto fnall = [=](String topic, String msg, String originator) {
-            this->subsMsg(topic, msg, originator);
-        };
+        auto fnall = msgHandler(this, &Rng::subsMsg);
         pSched->subscribe(tID, name + "/rng/#", fnall);
+        if (adaptiveMaxBits && entropy_estimate_irq == -1) {
+            entropy_estimate_irq = interruptIndex_input;
+        }
         startSelfTest();
         return true;
     }
@@ -292,6 +340,46 @@ class Rng {
         return samples;
     }
 
+    void setMaxBits(uint8_t bits) {
+        /*! Set the number of bits used of each sample of the random device
+
+        @param bits Number of bits [1..8] that are used of each sample, 0 selects automatic
+                    adaption to the measured min-entropy (default)
+        */
+        if (interruptIndex_input < 0 || interruptIndex_input >= USTD_MAX_RNG_PIRQS)
+            return;
+        if (bits == 0) {
+            adaptiveMaxBits = true;
+            if (entropy_estimate_irq == -1) {
+                entropy_estimate_irq = interruptIndex_input;
+            }
+            return;
+        }
+        if (bits > 8)
+            bits = 8;
+        adaptiveMaxBits = false;
+        if (entropy_estimate_irq == interruptIndex_input) {
+            entropy_estimate_irq = -1;
+        }
+        maxBits[interruptIndex_input] = bits;
+    }
+
+    uint8_t getMaxBits() {
+        /*! Get the number of bits currently used of each sample of the random device
+        @return number of bits [1..8]
+        */
+        if (interruptIndex_input < 0 || interruptIndex_input >= USTD_MAX_RNG_PIRQS)
+            return 0;
+        return maxBits[interruptIndex_input];
+    }
+
+    double getEntropyEstimate() {
+        /*! Get the last estimate of the min-entropy per sample of the random device
+        @return min-entropy in bits per sample, -1.0 if no estimate is available yet
+        */
+        return entropyEstimate;
+    }
+
   private:
     void byteToHex(uint8_t byte, char *buf) {
         uint8_t hc = byte >> 4;
@@ -325,6 +413,18 @@ class Rng {
         }
     }
 
+    void publishMaxBits() {
+        char msg[16];
+        formatLong(msg, getMaxBits());
+        pSched->publish(name + "/rng/state/maxbits", msg);
+        if (entropyEstimate < 0.0) {
+            pSched->publish(name + "/rng/state/entropy", "NaN");
+        } else {
+            formatFixed(msg, entropyEstimate, 2);
+            pSched->publish(name + "/rng/state/entropy", msg);
+        }
+    }
+
     void publish() {
         switch (rngSampleMode) {
         case RSM_NONE:
@@ -340,6 +440,38 @@ class Rng {
             pSched->publish(name + "/rng/state", "failed");
             break;
         }
+        publishMaxBits();
+    }
+
+    bool estimateEntropy(bool force = false) {
+        /* Most common value estimate (NIST SP 800-90B, 6.3.1) of the min-entropy of the interval
+           between two interrupts. Returns true, if maxBits has been changed. */
+        if (!adaptiveMaxBits || entropy_estimate_irq != interruptIndex_input)
+            return false;
+        if (raw_hist_count < USTD_RNG_ENTROPY_WINDOW && !force)
+            return false;
+        unsigned long n = getRawHistogram(rawHistogram);
+        if (n < 256)
+            return false;
+        unsigned long maxCount = 0;
+        for (int i = 0; i < 256; i++) {
+            if (rawHistogram[i] > maxCount)
+                maxCount = rawHistogram[i];
+        }
+        double p = (double)maxCount / (double)n;
+        double pu = p + 2.576 * sqrt(p * (1.0 - p) / (double)(n - 1));
+        if (pu > 1.0)
+            pu = 1.0;
+        entropyEstimate = -log(pu) / log(2.0);
+        int bits = (int)entropyEstimate;
+        if (bits < 1)
+            bits = 1;
+        if (bits > 8)
+            bits = 8;
+        if (maxBits[interruptIndex_input] == bits)
+            return false;
+        maxBits[interruptIndex_input] = bits;
+        return true;
     }
 
     void startSelfTest() {
@@ -349,6 +481,7 @@ class Rng {
 
     enum RngSelfTestState {RST_NONE, RST_INIT, RST_RUNNING, RST_SAMPLE_DONE, RST_FAILED, RST_OK};
     unsigned long rngHistogram[256];
+    uint16_t rawHistogram[256];
     const static unsigned long rngBufSize = 512;
     uint8_t rngBuf[rngBufSize];
     unsigned long dBuf[256];
@@ -469,6 +602,7 @@ class Rng {
             }
             break;
         case RST_SAMPLE_DONE:
+            estimateEntropy(true);
             if (evalRngSelfTest()) {
                 rngSelfTestState = RST_OK;
             } else {
@@ -513,6 +647,7 @@ class Rng {
     }
 
     void loop() {
+        MUPPLET_PROFILE_LOOP();
         rngStateLedUpdate();
         switch (rngSampleMode) {
         case RSM_SELF_TEST:
@@ -527,17 +662,22 @@ class Rng {
                         Serial.println("===RNG-START===");
                     }
                     rngSampleMode = RSM_OK;
+                    publish();
                     break;
                 case RST_FAILED:
                     #ifdef __USE_SERIAL_DBG__
                     Serial.println("RNG Self Test failed");
                     #endif
                     rngSampleMode = RSM_FAILED;
+                    publish();
                 break;
             }
             break;
         case RSM_OK:
             lastOkMillis = millis();
+            if (estimateEntropy()) {
+                publishMaxBits();
+            }
             if (!sampleRandomAndDistribute()) {
                 rngSampleMode = RSM_FAILED;
                 if (publishViaSerial) {
@@ -556,7 +696,8 @@ class Rng {
        lastIrqCount = getIrqCount();
     }
 
-    void subsMsg(String topic, String msg, String originator) {
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
         if (topic == name + "/rng/state/get") {
             publish();
         } else if (topic == name + "/rng/data/get") {
@@ -2,6 +2,9 @@
 #pragma once
 
 #include "scheduler.h"
+#include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
+#include "helper/publish_filter.h"
 
 namespace ustd {
 
@@ -13,6 +16,30 @@ namespace ustd {
 
 #define USTD_SW_MAX_IRQS (10)
 
+// switch modes, used in USTD_SWITCH_MODES
+#define USTD_SWITCH_MODE_DEFAULT 0x01        //!< Switch::Default
+#define USTD_SWITCH_MODE_RISING 0x02         //!< Switch::Rising
+#define USTD_SWITCH_MODE_FALLING 0x04        //!< Switch::Falling
+#define USTD_SWITCH_MODE_FLIPFLOP 0x08       //!< Switch::Flipflop
+#define USTD_SWITCH_MODE_TIMER 0x10          //!< Switch::Timer
+#define USTD_SWITCH_MODE_DURATION 0x20       //!< Switch::Duration
+#define USTD_SWITCH_MODE_BINARY_SENSOR 0x40  //!< Switch::BinarySensor
+#define USTD_SWITCH_MODE_ALL 0x7f            //!< all switch modes
+
+#ifndef USTD_SWITCH_MODES
+#define USTD_SWITCH_MODES USTD_SWITCH_MODE_ALL  //!< switch modes compiled into the Switch mupplet
+#endif
+
+#if (USTD_SWITCH_MODES & USTD_SWITCH_MODE_ALL) == 0
+#error "USTD_SWITCH_MODES must contain at least one switch mode"
+#elif (USTD_SWITCH_MODES & (USTD_SWITCH_MODES - 1)) == 0
+#define USTD_SWITCH_SINGLE_MODE  // the mode is a compile-time constant
+#endif
+
+constexpr uint8_t ustd_sw_first_mode(uint8_t modes, uint8_t mode = 0) {
+    return (modes >> mode) & 1 ? mode : ustd_sw_first_mode(modes, mode + 1);
+}
+
 volatile unsigned long pSwIrqCounter[USTD_SW_MAX_IRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 volatile unsigned long pSwLastIrq[USTD_SW_MAX_IRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 volatile unsigned long pSwDebounceMs[USTD_SW_MAX_IRQS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
@@ -128,6 +155,17 @@ hardware is detected.
 | `<mupplet-name>/switch/counter/start` |  | Start counter, `counter` messages will be sent, count is reset to 0. All counters are `off` by default.
 | `<mupplet-name>/switch/counter/stop` |  | Stop counting
 
+## Compile-time mode selection
+
+Applications that do not use all modes can select the modes that are compiled into the switch
+by defining `USTD_SWITCH_MODES` before the first mupplet header is included, e.g.
+`#define USTD_SWITCH_MODES (USTD_SWITCH_MODE_DEFAULT | USTD_SWITCH_MODE_FLIPFLOP)` or as build
+flag. Code, message parsing and state of the other modes are removed, \ref setMode ignores modes
+that are not compiled in. A switch that is instantiated with a mode that is not compiled in
+uses the first available mode. Only if exactly one mode is selected, the mode is a compile-time
+constant and the mode dispatch is resolved by the compiler. With two or more modes the mode is
+still checked at runtime, the dispatch only contains the compiled-in modes.
+
 More information:
 <a href="https://github.com/muwerk/mupplet-core/blob/master/extras/Switch-notes.md">Switch application
 notes</a>
@@ -152,12 +190,17 @@ class Switch {
     };
 
   private:
-    Scheduler *pSched;
+    Scheduler *pSched = nullptr;
     int tID;
+    MUPPLET_PROFILER
 
     String name;
     uint8_t port;
+#ifdef USTD_SWITCH_SINGLE_MODE
+    static const Mode mode = (Mode)ustd_sw_first_mode(USTD_SWITCH_MODES);
+#else
     Mode mode;
+#endif
     bool activeLogic;
     String customTopic;
     int8_t interruptIndex;
@@ -174,22 +217,52 @@ class Switch {
     bool bCounter = false;
     unsigned long counter = 0;
 
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FLIPFLOP
     bool flipflop = true;  // This starts with 'off', since state is initially changed once.
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
     unsigned long activeTimer = 0;
     unsigned long timerDuration = 1000;  // ms
-    unsigned long startEvent = 0;        // ms
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_DURATION
+    unsigned long startEvent = 0;  // ms
     unsigned long durations[2] = {3000, 30000};
+#endif
 
     unsigned long lastStatePublish = 0;  //!< last time, logical state was published
     unsigned int stateRefresh = 0;       //!< if !=0, and switch::mode is default, flipflop or binary_sensor, state is published every stateRefresh seconds
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_BINARY_SENSOR
     bool initialStatePublish = false;
     bool initialStateIsPublished = false;
+#endif
+    bool stateReplay = false;  //!< if true, the state is republished by a StateReplay coordinator
+    PublishFilter publisher;   //!< filter for state messages, see setPublishFilter()
+#ifdef USTD_FEATURE_STATE_CACHE
+    StateCache *pStateCache = nullptr;
+#endif
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    typedef struct {
+        uint32_t counter;
+        uint32_t timerDuration;  // ms
+        uint32_t durations[2];   // ms
+        uint8_t mode;
+        uint8_t flipflop;  // logical state of a flipflop
+        uint8_t counterActive;
+        uint8_t initialMode;  // mode passed to the constructor
+    } Snapshot;
+    StateSnapshot *pSnapshot = nullptr;
+    uint8_t initialMode = (uint8_t)mode;  // initialized after mode
+#endif
 
   public:
     Switch(String name, uint8_t port, Mode mode = Mode::Default, bool activeLogic = false,
            String customTopic = "", int8_t interruptIndex = -1, unsigned long debounceTimeMs = 0)
-        : name(name), port(port), mode(mode), activeLogic(activeLogic), customTopic(customTopic),
-          interruptIndex(interruptIndex), debounceTimeMs(debounceTimeMs) {
+        : name(name), port(port),
+#ifndef USTD_SWITCH_SINGLE_MODE
+          mode(isModeAvailable(mode) ? mode : (Mode)ustd_sw_first_mode(USTD_SWITCH_MODES)),
+#endif
+          activeLogic(activeLogic), customTopic(customTopic), interruptIndex(interruptIndex),
+          debounceTimeMs(debounceTimeMs) {
         /*! Instantiate a muwerk switch
 
         @param name The name of the switch mupplet, referenced in pub/sub messages
@@ -233,6 +306,13 @@ class Switch {
             counter = 0;
             publishCounter();
         }
+#ifdef USTD_FEATURE_STATE_CACHE
+        if (!bCounter && pStateCache) {
+            // a stopped counter is answered with `NaN`, which is not published here
+            pStateCache->invalidate(name + "/switch/counter");
+        }
+#endif
+        saveSnapshot();
     }
 
     void setTimerDuration(unsigned long ms) {
@@ -242,7 +322,10 @@ class Switch {
 
         @param ms time in ms.
         */
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
         timerDuration = ms;
+        saveSnapshot();
+#endif
     }
 
     void setMode(Mode newmode, unsigned long duration = 0) {
@@ -251,36 +334,82 @@ class Switch {
         @param newmode The new \ref Mode
         @param duration For Mode::Timer: the length in ms the switch stays on on reception of a
         trigger.
+
+        Modes that are not compiled in (see `USTD_SWITCH_MODES`) are ignored.
         */
+        if (!isModeAvailable(newmode))
+            return;
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FLIPFLOP
         if (useInterrupt)
             flipflop = false;  // This starts with 'off', since state is
                                // initially changed once.
         else
             flipflop = true;  // This starts with 'off', since state is
                               // initially changed once.
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
         activeTimer = 0;
         timerDuration = duration;
+#endif
         physicalState = -1;
         logicalState = -1;
         overriddenPhysicalState = false;
+#ifdef USTD_FEATURE_STATE_CACHE
+        if (pStateCache) {
+            // the state is published on another topic in the new mode
+            pStateCache->invalidate(name);
+        }
+#endif
+        publisher.invalidate();  // the state is published again in the new mode
         overridePhysicalActive = false;
         lastChangeMs = 0;
+#ifndef USTD_SWITCH_SINGLE_MODE
         mode = newmode;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_BINARY_SENSOR
         if (mode == Mode::BinarySensor) {
             initialStateIsPublished = false;
             initialStatePublish = true;
             stateRefresh = 600;
         }
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_DURATION
         startEvent = (unsigned long)-1;
+#endif
+        saveSnapshot();
+    }
+
+    static constexpr bool isModeAvailable(Mode mode) {
+        /*! Check if a switch \ref Mode is compiled in (see `USTD_SWITCH_MODES`)
+        @param mode Switch \ref Mode
+        @return `true` if the mode is available
+        */
+        return (USTD_SWITCH_MODES >> mode) & 1;
     }
 
     void begin(Scheduler *_pSched) {
         /*! Initialize GPIOs and activate switch hardware
          */
+        MUPPLET_PROFILE_SETUP();
         pSched = _pSched;
+        publisher.begin(pSched);
 
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        Snapshot snap;
+        bool restored = pSnapshot && pSnapshot->restore(name, &snap, sizeof(snap)) &&
+                        isValidSnapshot(snap);
+#endif
         pinMode(port, INPUT_PULLUP);
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        if (restored && snap.initialMode == initialMode) {
+            setMode((Mode)snap.mode);
+        } else {
+            // a firmware update may have changed the mode passed to the constructor
+            setMode(mode);
+        }
+#else
         setMode(mode);
+#endif
 
         if (interruptIndex >= 0 && interruptIndex < USTD_SW_MAX_IRQS) {
             ipin = digitalPinToInterrupt(port);
@@ -299,14 +428,31 @@ class Switch {
             useInterrupt = true;
         }
 
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        if (restored) {
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
+            timerDuration = snap.timerDuration;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_DURATION
+            durations[0] = snap.durations[0];
+            durations[1] = snap.durations[1];
+#endif
+            bCounter = snap.counterActive;
+            counter = snap.counter;
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FLIPFLOP
+            // the first evaluation of the switch toggles the flipflop (polling mode only)
+            flipflop = useInterrupt ? snap.flipflop : !snap.flipflop;
+#endif
+            saveSnapshot();
+        }
+#endif
         readState();
 
         auto ft = [=]() { this->loop(); };
         tID = pSched->add(ft, name, 50000);
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
 
-        auto fnall = [=](String topic, String msg, String originator) {
-            this->subsMsg(topic, msg, originator);
-        };
+        auto fnall = msgHandler(this, &Switch::subsMsg);
         pSched->subscribe(tID, name + "/#", fnall);
         pSched->subscribe(tID, "mqtt/state", fnall);
     }
@@ -328,6 +474,7 @@ class Switch {
                     publishCounter();
                 }
             }
+            saveSnapshot();
         }
     }
 
@@ -338,6 +485,26 @@ class Switch {
         stateRefresh = logicalStateRefreshEverySecs;
     }
 
+    void setPublishFilter(bool suppressDuplicates, unsigned long coalesceMs = 0) {
+        /*! Configure the filter for state messages (see \ref PublishFilter)
+
+        By default, the state of modes default, flipflop, timer and binary_sensor is only
+        published if it changed. Answers to `get` requests, the periodic refresh (see \ref
+        setStateRefresh) and the state replay are always published. Triggers and durations are
+        never filtered.
+
+        Coalescing drops the intermediate states of a window: in modes default and flipflop, a
+        short press that is released again within the window (off - on - off) is not published
+        at all. Use coalescing only if intermediate states may be lost, e.g. for noisy binary
+        sensors, not for buttons whose presses must be seen.
+
+        @param suppressDuplicates If `true` (default), an unchanged state is not published
+        @param coalesceMs Coalescing window in ms: rapid state changes are published at most once
+                          per window with the last state, 0 (default) publishes immediately
+        */
+        publisher.configure(suppressDuplicates, coalesceMs);
+    }
+
     void setToggle() {
         /*! Temporarily override the physical state of the switch by toggling the current state.
 
@@ -357,6 +524,61 @@ class Switch {
         setPhysicalState(false, true);
     }
 
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    void registerStateSnapshot(StateSnapshot *pSnapshot) {
+        /*! Restore the state of the switch from a \ref StateSnapshot after a reboot
+
+        Mode, timer and duration settings, counter and the state of a flipflop are saved on every
+        change and restored by \ref begin(). The saved mode is ignored if the switch has been
+        instantiated with a different mode since. **Must** be called before \ref begin().
+
+        @param pSnapshot Pointer to the state snapshot
+        */
+        this->pSnapshot = pSnapshot;
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_CACHE
+    void registerStateCache(StateCache *pCache) {
+        /*! Answer state requests of the switch from a \ref StateCache
+
+        The requests for `switch/state`, `binary_sensor/state` (together with the custom topic,
+        if any) and the counter are answered with the last published values without involving
+        the switch. The physical state is not cached, since it is only published on request.
+
+        @param pCache Pointer to the state cache
+        */
+        pCache->addTopic(name + "/switch/state");
+        pCache->addTopic(name + "/binary_sensor/state");
+        if (customTopic != "") {
+            pCache->addTopic(customTopic, name + "/switch/state/get");
+            pCache->addTopic(customTopic, name + "/binary_sensor/state/get");
+        }
+        const char *counterRequests[] = {"/switch/counter/get", "/sensor/counter/get"};
+        for (const char *request : counterRequests) {
+            pCache->addTopic(name + "/switch/counter", name + request);
+            pCache->addTopic(name + "/sensor/counter", name + request);
+        }
+        pStateCache = pCache;
+    }
+#endif
+
+#ifdef USTD_FEATURE_STATE_REPLAY
+    void registerStateReplay(StateReplay *pReplay, uint8_t priority = 128) {
+        /*! Let a \ref StateReplay coordinator republish the state after an MQTT (re-)connect
+
+        The switch no longer republishes its state on its own when the MQTT connection is
+        established.
+
+        @param pReplay Pointer to the state replay coordinator
+        @param priority Replay priority: lower values are replayed first
+        */
+        if (pReplay->add([this]() { this->replayState(); }, priority) != -1) {
+            stateReplay = true;
+        }
+    }
+#endif
+
   private:
     unsigned long getTimestamp() {
         /*! Create a unix timestamp eq. to calling time(nullptr) for all platforms, including those without time.h, time_t */
@@ -367,9 +589,54 @@ class Switch {
 #endif
     }
 
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+    static bool isValidSnapshot(const Snapshot &snap) {
+        // the snapshot comes from RTC memory or flash: never trust the mode and flag bytes
+        return snap.mode <= Mode::BinarySensor && isModeAvailable((Mode)snap.mode) &&
+               snap.flipflop <= 1 && snap.counterActive <= 1;
+    }
+#endif
+
+    void saveSnapshot() {
+#ifdef USTD_FEATURE_STATE_SNAPSHOT
+        if (pSnapshot && pSched) {  // not before begin(): the snapshot is not restored yet
+            Snapshot snap = {(uint32_t)counter, 0, {0, 0}, (uint8_t)mode, 0, bCounter,
+                             initialMode};
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
+            snap.timerDuration = timerDuration;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_DURATION
+            snap.durations[0] = durations[0];
+            snap.durations[1] = durations[1];
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FLIPFLOP
+            // until the first evaluation in polling mode, flipflop holds the inverted state
+            snap.flipflop = (logicalState == -1 && !useInterrupt) ? !flipflop : flipflop;
+#endif
+            pSnapshot->update(name, &snap, sizeof(snap));
+        }
+#endif
+    }
+
+    void replayState() {
+        if (mode == Mode::Default || mode == Mode::Flipflop || mode == Mode::BinarySensor) {
+            publishLogicalState(logicalState, true);
+            if (bCounter) {
+                publishCounter();
+            }
+        }
+    }
+
+#ifdef USTD_FEATURE_STATE_CACHE
+    bool hasCachedState() {
+        return mode == Mode::Default || mode == Mode::Flipflop || mode == Mode::Timer ||
+               mode == Mode::BinarySensor;
+    }
+#endif
+
     void publishCounter() {
         char buf[32];
-        sprintf(buf, "%ld", counter);
+        formatUnsignedLong(buf, counter);
         if (bCounter) {
             pSched->publish(name + "/switch/counter", buf);
             pSched->publish(name + "/sensor/counter", buf);
@@ -379,7 +646,7 @@ class Switch {
         }
     }
 
-    void publishLogicalState(bool lState) {
+    void publishLogicalState(bool lState, bool force = false) {
         String textState;
         String binaryState;
         lastStatePublish = getTimestamp();
@@ -394,10 +661,11 @@ class Switch {
         case Mode::Default:
         case Mode::Flipflop:
         case Mode::Timer:
-            pSched->publish(name + "/switch/state", textState);
+            publisher.publish(name + "/switch/state", textState, force);
             if (customTopic != "")
-                pSched->publish(customTopic, textState);
+                publisher.publish(customTopic, textState, force);
             break;
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_RISING
         case Mode::Rising:
             if (lState == true) {
                 pSched->publish(name + "/switch/state", "trigger");
@@ -405,6 +673,8 @@ class Switch {
                     pSched->publish(customTopic, "trigger");
             }
             break;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FALLING
         case Mode::Falling:
             if (lState == false) {
                 pSched->publish(name + "/switch/state", "trigger");
@@ -412,6 +682,8 @@ class Switch {
                     pSched->publish(customTopic, "trigger");
             }
             break;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_DURATION
         case Mode::Duration:
             if (lState == true) {
                 startEvent = millis();
@@ -419,7 +691,7 @@ class Switch {
                 if (startEvent != (unsigned long)-1) {
                     unsigned long dt = timeDiff(startEvent, millis());
                     char msg[32];
-                    sprintf(msg, "%ld", dt);
+                    formatUnsignedLong(msg, dt);
                     pSched->publish(name + "/switch/duration", msg);
                     if (dt < durations[0]) {
                         pSched->publish(name + "/switch/shortpress", "trigger");
@@ -431,10 +703,15 @@ class Switch {
                 }
             }
             break;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_BINARY_SENSOR
         case Mode::BinarySensor:
-            pSched->publish(name + "/binary_sensor/state", binaryState);
+            publisher.publish(name + "/binary_sensor/state", binaryState, force);
             if (customTopic != "")
-                pSched->publish(customTopic, binaryState);
+                publisher.publish(customTopic, binaryState, force);
+            break;
+#endif
+        default:
             break;
         }
     }
@@ -448,12 +725,15 @@ class Switch {
         case Mode::BinarySensor:
             setLogicalState(physicalState);
             break;
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FLIPFLOP
         case Mode::Flipflop:
             if (physicalState == false) {
                 flipflop = !flipflop;
                 setLogicalState(flipflop);
             }
             break;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
         case Mode::Timer:
             if (physicalState == false) {
                 activeTimer = millis();
@@ -461,13 +741,18 @@ class Switch {
                 setLogicalState(true);
             }
             break;
+#endif
+        default:
+            break;
         }
     }
 
     void setPhysicalState(bool newState, bool override) {
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
         if (mode != Mode::Timer) {
             activeTimer = 0;
         }
+#endif
         if (override) {
             overriddenPhysicalState = physicalState;
             overridePhysicalActive = true;
@@ -497,13 +782,14 @@ class Switch {
             int curstate = digitalRead(port);
             char msg[32];
             if (count) {
-                sprintf(msg, "%ld", count);
+                formatUnsignedLong(msg, count);
                 pSched->publish(name + "/switch/irqcount/0", msg);
                 if (curstate == HIGH)
                     curstate = true;
                 else
                     curstate = false;
                 switch (mode) {
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_RISING
                 case Mode::Rising:
                     for (unsigned long i = 0; i < count; i++) {
                         if (activeLogic) {
@@ -515,6 +801,8 @@ class Switch {
                         }
                     }
                     break;
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FALLING
                 case Mode::Falling:
                     for (unsigned long i = 0; i < count; i++) {
                         if (activeLogic) {
@@ -526,6 +814,7 @@ class Switch {
                         }
                     }
                     break;
+#endif
                 default:
                     bool iState = ((count % 2) == 0);
                     if (curstate)
@@ -554,36 +843,46 @@ class Switch {
     }
 
     void loop() {
+        MUPPLET_PROFILE_LOOP();
+        publisher.loop();
         readState();
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
         if (mode == Mode::Timer && activeTimer) {
             if (timeDiff(activeTimer, millis()) > timerDuration) {
                 activeTimer = 0;
                 setLogicalState(false);
             }
         }
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_BINARY_SENSOR
         if (stateRefresh != 0 || (initialStateIsPublished = false && initialStatePublish == true)) {
             if (mode == Mode::BinarySensor) {
                 if (getTimestamp() - lastStatePublish > stateRefresh || (initialStateIsPublished = false && initialStatePublish == true)) {
-                    publishLogicalState(logicalState);
+                    publishLogicalState(logicalState, true);
                     if (bCounter) publishCounter();
                     initialStateIsPublished = true;
                 }
             }
         }
+#endif
     }
 
-    void subsMsg(String topic, String msg, String originator) {
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
+#ifdef USTD_FEATURE_STATE_CACHE
+        // a pending coalesced value is newer than the cache: answer with a forced publish.
+        // In the trigger and duration modes the state topics carry events, not a state.
+        if (pStateCache && !publisher.hasPending() && hasCachedState() &&
+            pStateCache->answer(topic)) {
+            return;
+        }
+#endif
         if (topic == name + "/switch/state/get" || topic == name + "/binary_sensor/state/get") {
-            publishLogicalState(logicalState);
+            publishLogicalState(logicalState, true);
         } else if (topic == name + "/switch/counter/get" || topic == name + "/sensor/counter/get") {
             publishCounter();
         } else if (topic == name + "/switch/physicalstate/get") {
-            char buf[32];
-            if (physicalState)
-                sprintf(buf, "on");
-            else
-                sprintf(buf, "off");
-            pSched->publish(name + "/switch/physicalstate", buf);
+            pSched->publish(name + "/switch/physicalstate", physicalState ? "on" : "off");
         } else if (topic == name + "/switch/mode/set") {
             char buf[32];
             memset(buf, 0, 32);
@@ -600,20 +899,31 @@ class Switch {
                 }
             }
             if (!strcmp(buf, "default")) {
-                setMode(Mode::Default);
+                setMode(Mode::Default);  // ignored, if not compiled in
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_RISING
             } else if (!strcmp(buf, "rising")) {
                 setMode(Mode::Rising);
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FALLING
             } else if (!strcmp(buf, "falling")) {
                 setMode(Mode::Falling);
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_FLIPFLOP
             } else if (!strcmp(buf, "flipflop")) {
                 setMode(Mode::Flipflop);
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_BINARY_SENSOR
             } else if (!strcmp(buf, "binary_sensor")) {
                 setMode(Mode::BinarySensor);
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_TIMER
             } else if (!strcmp(buf, "timer")) {
                 unsigned long dur = 1000;
                 if (p)
                     dur = atol(p);
                 setMode(Mode::Timer, dur);
+#endif
+#if USTD_SWITCH_MODES & USTD_SWITCH_MODE_DURATION
             } else if (!strcmp(buf, "duration")) {
                 durations[0] = 3000;
                 durations[1] = 30000;
@@ -626,6 +936,7 @@ class Switch {
                     durations[1] = (unsigned long)-1;
                 }
                 setMode(Mode::Duration);
+#endif
             }
         } else if (topic == name + "/switch/set") {
             char buf[32];
@@ -647,19 +958,14 @@ class Switch {
             }
         } else if (topic == name + "/switch/debounce/get") {
             char buf[32];
-            sprintf(buf, "%ld", debounceTimeMs);
+            formatUnsignedLong(buf, debounceTimeMs);
             pSched->publish(name + "/debounce", buf);
         } else if (topic == name + "/switch/debounce/set") {
             long dbt = atol(msg.c_str());
             setDebounce(dbt);
         } else if (topic == "mqtt/state") {
-            if (mode == Mode::Default || mode == Mode::Flipflop || mode == Mode::BinarySensor) {
-                if (msg == "connected") {
-                    publishLogicalState(logicalState);
-                    if (bCounter) {
-                        publishCounter();
-                    }
-                }
+            if (msg == "connected" && !stateReplay) {
+                replayState();
             }
         } else if (topic == name + "/switch/counter/start") {
             activateCounter(true);
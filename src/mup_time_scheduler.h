@@ -0,0 +1,540 @@
+// mup_time_scheduler.h - muwerk time-of-day and astronomical scheduler applet
+#pragma once
+
+#include "scheduler.h"
+#include "mupplet_core.h"
+#include "helper/mupplet_profiler.h"
+#include "helper/mup_astro.h"
+
+namespace ustd {
+
+#define USTD_TS_MAX_RULES (16)
+#define USTD_TS_SUN_CACHE_DAYS (4)  // days with cached sun times, covers the rule search window
+
+// clang-format off
+/*! \brief mupplet-core TimeScheduler class
+
+The TimeScheduler publishes messages at specific times of the day, so that other mupplets or the
+application do not need to poll the wall-clock time. Two kinds of rules are supported:
+
+* **Events** fire at a time of the day, e.g. `22:30` or `sunset+15`.
+* **Intervals** are switched on at a start time and switched off at an end time, e.g. between
+  `18:00` and `00:00` or between `sunset` and `sunrise`.
+
+Times are either a local time `hh:mm` or a sun event (`sunrise`, `sunset`, `noon`, `civildawn`,
+`civildusk`, `nauticaldawn`, `nauticaldusk`) with an optional offset in minutes (`sunset+15`,
+`sunrise-30`). Sun events require an \ref Astro object with the location. On days on which a
+sun event does not occur (polar day or night), rules referencing it are skipped.
+
+Each rule can be restricted to days of the week: `daily` (default), `weekdays`, `weekends` or a
+comma separated list like `mon,wed,fri`. For intervals, the day restriction applies to the start
+time.
+
+The next time of every rule is kept in a min-heap ordered by time. The scheduler task only
+compares the current time with the top of the heap; the next time of a rule is only calculated
+after the rule has fired. A jump of the system time (e.g. after the first NTP synchronization)
+causes a recalculation of all rules.
+
+The local time is derived from UTC with the `utcOffset` of the \ref Astro object or the offset
+given to the constructor.
+
+## Messages
+
+### Messages sent by the time scheduler mupplet:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<mupplet-name>/timer/<rule>` | `trigger` | An event rule fired.
+| `<mupplet-name>/timer/<rule>/state` | `on`, `off` | State of an interval rule, sent on transitions, when the system time becomes valid and after the connection to the MQTT server has been established.
+
+### Message received by the time scheduler mupplet:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<mupplet-name>/timer/<rule>/state/get` | | Sends the state of an interval rule.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "mup_time_scheduler.h"
+
+ustd::Scheduler sched;
+ustd::Astro astro(48.1374, 11.5755, 3600);
+ustd::TimeScheduler timer("timer", &astro);
+
+void onGarden(String topic, String msg, String originator) {
+    // msg is "on" between 15 minutes after sunset and midnight, otherwise "off"
+}
+
+void appLoop() {
+    // your code here...
+}
+
+void setup() {
+    timer.addEvent("goodnight", "22:30", "weekdays");
+    timer.addInterval("garden", "sunset+15", "00:00");
+    timer.begin(&sched);
+
+    int tID = sched.add(appLoop, "main", 1000000);
+    sched.subscribe(tID, "timer/timer/garden/state", onGarden);
+}
+\endcode
+*/
+// clang-format on
+class TimeScheduler {
+  public:
+    static const char *version;  // = "0.1.0";
+
+    /*! Reference of a time specification */
+    enum TimeBase {
+        LocalTime,    /*!< offset is the local time in minutes since midnight */
+        Sunrise,      /*!< offset in minutes relative to sunrise */
+        Sunset,       /*!< offset in minutes relative to sunset */
+        Noon,         /*!< offset in minutes relative to solar noon */
+        CivilDawn,    /*!< offset in minutes relative to the begin of civil twilight */
+        CivilDusk,    /*!< offset in minutes relative to the end of civil twilight */
+        NauticalDawn, /*!< offset in minutes relative to the begin of nautical twilight */
+        NauticalDusk  /*!< offset in minutes relative to the end of nautical twilight */
+    };
+
+  private:
+    typedef struct {
+        uint8_t base;
+        int16_t offset;
+    } TimeSpec;
+
+    typedef struct {
+        String name;
+        TimeSpec start;
+        TimeSpec end;
+        bool interval;
+        uint8_t weekdays;
+        bool state;
+        time_t next;
+    } Rule;
+
+    typedef struct {
+        long day;
+        Astro::SunTimes times;
+    } SunCacheEntry;
+
+    // muwerk task management
+    Scheduler *pSched;
+    int tID;
+    MUPPLET_PROFILER
+
+    // configuration
+    String name;
+    Astro *pAstro;
+    long utcOffset;
+
+    // runtime
+    Rule rules[USTD_TS_MAX_RULES];
+    uint8_t heap[USTD_TS_MAX_RULES];
+    uint8_t ruleCount = 0;
+    time_t lastNow = 0;
+    bool timeValid = false;
+    // the rule search visits several days, the Astro object only caches one day
+    SunCacheEntry sunCache[USTD_TS_SUN_CACHE_DAYS];
+    uint8_t sunCacheNext = 0;
+    bool sunCacheValid = false;
+    double sunCacheLat, sunCacheLon, sunCacheOffset;
+
+  public:
+    TimeScheduler(String name, Astro *pAstro) : name(name), pAstro(pAstro), utcOffset(0) {
+        /*! Instantiate a time scheduler that supports sun events
+
+        @param name Name of the scheduler, used to reference it by pub/sub messages
+        @param pAstro Pointer to an \ref Astro object with the location and UTC offset
+        */
+    }
+
+    TimeScheduler(String name, long utcOffset = 0)
+        : name(name), pAstro(nullptr), utcOffset(utcOffset) {
+        /*! Instantiate a time scheduler for local times
+
+        @param name Name of the scheduler, used to reference it by pub/sub messages
+        @param utcOffset UTC time offset of the local time in seconds
+        */
+    }
+
+    void begin(Scheduler *_pSched, unsigned long intervalUs = 1000000) {
+        /*! Start operation
+
+        @param _pSched Pointer to Scheduler object, used for internal task and pub/sub.
+        @param intervalUs Interval in microseconds in which the top of the heap is checked
+        */
+        MUPPLET_PROFILE_SETUP();
+        pSched = _pSched;
+        auto ft = [=]() { this->loop(); };
+        tID = pSched->add(ft, name, intervalUs);
+        MUPPLET_PROFILE_BEGIN(pSched, tID, name);
+        auto fnall = msgHandler(this, &TimeScheduler::subsMsg);
+        pSched->subscribe(tID, name + "/timer/#", fnall);
+        pSched->subscribe(tID, "mqtt/state", fnall);
+        loop();
+    }
+
+    int addEvent(String ruleName, String at, String weekdays = "daily") {
+        /*! Add a rule that fires at a time of the day
+
+        @param ruleName Name of the rule, used in the topic `<mupplet-name>/timer/<rule>`
+        @param at Time of the event, e.g. `22:30` or `sunset+15`
+        @param weekdays Days on which the rule fires: `daily`, `weekdays`, `weekends` or a list
+                        like `mon,wed,fri`
+        @return Index of the rule or -1 if the rule is invalid or no more rules can be added
+        */
+        TimeSpec spec;
+        if (!parseTime(at, &spec)) {
+            return -1;
+        }
+        return addRule(ruleName, spec, spec, false, weekdays);
+    }
+
+    int addInterval(String ruleName, String start, String end, String weekdays = "daily") {
+        /*! Add a rule that is on between a start and an end time
+
+        @param ruleName Name of the rule, used in the topic `<mupplet-name>/timer/<rule>/state`
+        @param start Start time of the interval, e.g. `18:00` or `sunset`
+        @param end End time of the interval, e.g. `00:00` or `sunrise-30`
+        @param weekdays Days on which the interval starts: `daily`, `weekdays`, `weekends` or a
+                        list like `mon,wed,fri`
+        @return Index of the rule or -1 if the rule is invalid or no more rules can be added
+        */
+        TimeSpec startSpec, endSpec;
+        if (!parseTime(start, &startSpec) || !parseTime(end, &endSpec)) {
+            return -1;
+        }
+        return addRule(ruleName, startSpec, endSpec, true, weekdays);
+    }
+
+    bool getState(String ruleName) {
+        /*! Get the state of an interval rule
+        @param ruleName Name of the rule
+        @return `true` if the interval is active
+        */
+        int index = findRule(ruleName);
+        return index != -1 && rules[index].state;
+    }
+
+    time_t getNext(String ruleName) {
+        /*! Get the next time a rule fires or changes its state
+        @param ruleName Name of the rule
+        @return Unix timestamp (UTC) of the next transition or 0 if the rule never fires
+        */
+        int index = findRule(ruleName);
+        return index == -1 || !timeValid ? 0 : rules[index].next;
+    }
+
+  private:
+    int addRule(String ruleName, TimeSpec start, TimeSpec end, bool interval, String weekdays) {
+        uint8_t mask = parseWeekdays(weekdays);
+        if (ruleCount >= USTD_TS_MAX_RULES || !mask || findRule(ruleName) != -1) {
+            return -1;
+        }
+        if ((start.base != LocalTime || end.base != LocalTime) && !pAstro) {
+            return -1;
+        }
+        Rule &rule = rules[ruleCount];
+        rule.name = ruleName;
+        rule.start = start;
+        rule.end = end;
+        rule.interval = interval;
+        rule.weekdays = mask;
+        rule.state = false;
+        rule.next = 0;
+        heap[ruleCount] = ruleCount;
+        ++ruleCount;
+        if (timeValid) {
+            // schedule the new rule without disturbing the others
+            time_t now = time(nullptr);
+            schedule(ruleCount - 1, now, true);
+            siftUp(ruleCount - 1);
+        }
+        return ruleCount - 1;
+    }
+
+    int findRule(const String &ruleName) {
+        for (uint8_t i = 0; i < ruleCount; i++) {
+            if (rules[i].name == ruleName) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    static bool parseTime(String spec, TimeSpec *pSpec) {
+        static const char *bases[] = {"",          "sunrise",   "sunset",       "noon",
+                                      "civildawn", "civildusk", "nauticaldawn", "nauticaldusk",
+                                      nullptr};
+        spec.trim();
+        spec.toLowerCase();
+        int hour, minute;
+        if (Astro::parseHourMinuteString(spec, &hour, &minute)) {
+            pSpec->base = LocalTime;
+            pSpec->offset = hour * 60 + minute;
+            return true;
+        }
+        int sign = spec.indexOf('+');
+        if (sign == -1) {
+            sign = spec.indexOf('-');
+        }
+        String event = sign == -1 ? spec : spec.substring(0, sign);
+        int16_t base = parseToken(event, bases);
+        if (base < Sunrise) {
+            return false;
+        }
+        long offset = 0;
+        if (sign != -1) {
+            offset = parseLong(spec.substring(sign + 1), -100000);
+            if (offset < 0 || offset > 1440) {
+                return false;
+            }
+            if (spec[sign] == '-') {
+                offset = -offset;
+            }
+        }
+        pSpec->base = (uint8_t)base;
+        pSpec->offset = (int16_t)offset;
+        return true;
+    }
+
+    static uint8_t parseWeekdays(String weekdays) {
+        // bit 0 is sunday, same as tm_wday
+        static const char *days[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat", nullptr};
+        weekdays.trim();
+        weekdays.toLowerCase();
+        if (weekdays == "" || weekdays == "daily") {
+            return 0x7f;
+        } else if (weekdays == "weekdays") {
+            return 0x3e;
+        } else if (weekdays == "weekends") {
+            return 0x41;
+        }
+        uint8_t mask = 0;
+        while (weekdays.length()) {
+            int ind = weekdays.indexOf(',');
+            String day = ind == -1 ? weekdays : weekdays.substring(0, ind);
+            weekdays = ind == -1 ? "" : weekdays.substring(ind + 1);
+            int16_t index = parseToken(day, days);
+            if (index == -1) {
+                return 0;
+            }
+            mask |= 1 << index;
+        }
+        return mask;
+    }
+
+    long getUtcOffset() {
+        return pAstro ? (long)pAstro->utcOffset : utcOffset;
+    }
+
+    bool specTime(const TimeSpec &spec, long day, time_t *pTime) {
+        // time of a time specification on a local day (days since 1970-01-01)
+        long minute = spec.offset;
+        if (spec.base != LocalTime) {
+            const Astro::SunTimes &st = getSunTimes(day);
+            int16_t event = spec.base == Sunrise        ? st.sunrise
+                            : spec.base == Sunset       ? st.sunset
+                            : spec.base == Noon         ? st.noon
+                            : spec.base == CivilDawn    ? st.civilDawn
+                            : spec.base == CivilDusk    ? st.civilDusk
+                            : spec.base == NauticalDawn ? st.nauticalDawn
+                                                        : st.nauticalDusk;
+            if (event < 0) {
+                return false;
+            }
+            minute += event;
+        }
+        *pTime = (time_t)day * 86400 + minute * 60 - getUtcOffset();
+        return true;
+    }
+
+    const Astro::SunTimes &getSunTimes(long day) {
+        // sun times of a local day from the cache of the last USTD_TS_SUN_CACHE_DAYS days
+        if (!sunCacheValid || pAstro->lat != sunCacheLat || pAstro->lon != sunCacheLon ||
+            pAstro->utcOffset != sunCacheOffset) {
+            // first use or the location or time zone changed
+            for (uint8_t i = 0; i < USTD_TS_SUN_CACHE_DAYS; i++) {
+                sunCache[i].day = -0x7fffffffL;
+            }
+            sunCacheLat = pAstro->lat;
+            sunCacheLon = pAstro->lon;
+            sunCacheOffset = pAstro->utcOffset;
+            sunCacheValid = true;
+        }
+        for (uint8_t i = 0; i < USTD_TS_SUN_CACHE_DAYS; i++) {
+            if (sunCache[i].day == day) {
+                return sunCache[i].times;
+            }
+        }
+        SunCacheEntry &entry = sunCache[sunCacheNext];
+        sunCacheNext = (sunCacheNext + 1) % USTD_TS_SUN_CACHE_DAYS;
+        entry.day = day;
+        entry.times = pAstro->getSunTimes((time_t)day * 86400 + 43200 - getUtcOffset());
+        return entry.times;
+    }
+
+    static bool dayMatches(long day, uint8_t weekdays) {
+        // 1970-01-01 was a thursday
+        return weekdays & (1 << ((day % 7 + 11) % 7));
+    }
+
+    long localDay(time_t t) {
+        time_t local = t + getUtcOffset();
+        return (long)(local >= 0 ? local / 86400 : (local - 86399) / 86400);
+    }
+
+    time_t nextTime(const TimeSpec &spec, uint8_t weekdays, time_t after) {
+        // first time of spec strictly after 'after' (0 if none within 8 days)
+        long first = localDay(after) - 1;
+        for (long day = first; day <= first + 8; day++) {
+            time_t t;
+            if (dayMatches(day, weekdays) && specTime(spec, day, &t) && t > after) {
+                return t;
+            }
+        }
+        return 0;
+    }
+
+    time_t prevTime(const TimeSpec &spec, uint8_t weekdays, time_t notAfter) {
+        // last time of spec at or before 'notAfter' (0 if none within 8 days)
+        long first = localDay(notAfter) + 1;
+        for (long day = first; day >= first - 8; day--) {
+            time_t t;
+            if (dayMatches(day, weekdays) && specTime(spec, day, &t) && t <= notAfter) {
+                return t;
+            }
+        }
+        return 0;
+    }
+
+    void schedule(uint8_t index, time_t now, bool initial) {
+        // calculate the next transition of a rule after now
+        Rule &rule = rules[index];
+        if (!rule.interval) {
+            rule.next = nextTime(rule.start, rule.weekdays, now);
+            return;
+        }
+        bool state = false;
+        time_t start = prevTime(rule.start, rule.weekdays, now);
+        time_t end = 0;
+        if (start) {
+            end = nextTime(rule.end, 0x7f, start);
+            state = end > now;
+        }
+        rule.next = state ? end : nextTime(rule.start, rule.weekdays, now);
+        if (initial || state != rule.state) {
+            rule.state = state;
+            publishState(index);
+        }
+    }
+
+    void publishState(uint8_t index) {
+        pSched->publish(name + "/timer/" + rules[index].name + "/state",
+                        rules[index].state ? "on" : "off");
+    }
+
+    bool before(uint8_t a, uint8_t b) {
+        // rules that never fire (next == 0) are sorted to the end of the heap
+        time_t ta = rules[heap[a]].next;
+        time_t tb = rules[heap[b]].next;
+        return ta && (!tb || ta < tb);
+    }
+
+    void swap(uint8_t a, uint8_t b) {
+        uint8_t tmp = heap[a];
+        heap[a] = heap[b];
+        heap[b] = tmp;
+    }
+
+    void siftUp(uint8_t i) {
+        while (i > 0 && before(i, (i - 1) / 2)) {
+            swap(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void siftDown(uint8_t i) {
+        for (;;) {
+            uint8_t smallest = i;
+            uint8_t left = 2 * i + 1;
+            uint8_t right = left + 1;
+            if (left < ruleCount && before(left, smallest)) {
+                smallest = left;
+            }
+            if (right < ruleCount && before(right, smallest)) {
+                smallest = right;
+            }
+            if (smallest == i) {
+                return;
+            }
+            swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void rebuild(time_t now) {
+        for (uint8_t i = 0; i < ruleCount; i++) {
+            heap[i] = i;
+            schedule(i, now, !timeValid);
+        }
+        for (int i = ruleCount / 2 - 1; i >= 0; i--) {
+            siftDown(i);
+        }
+    }
+
+    void loop() {
+        MUPPLET_PROFILE_LOOP();
+        time_t now = time(nullptr);
+        if (now < 1600000000L) {
+            // system time not yet set
+            return;
+        }
+        if (!timeValid || now < lastNow - 60 || now > lastNow + 3600) {
+            // first valid time or time jump: recalculate all rules
+            rebuild(now);
+            timeValid = true;
+        }
+        lastNow = now;
+        while (ruleCount && rules[heap[0]].next && rules[heap[0]].next <= now) {
+            uint8_t index = heap[0];
+            Rule &rule = rules[index];
+            if (rule.interval) {
+                schedule(index, now, false);
+            } else {
+                pSched->publish(name + "/timer/" + rule.name, "trigger");
+                rule.next = nextTime(rule.start, rule.weekdays, now);
+            }
+            siftDown(0);
+        }
+    }
+
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        MUPPLET_PROFILE_MSG(topic);
+        if (topic == "mqtt/state") {
+            if (msg == "connected" && timeValid) {
+                for (uint8_t i = 0; i < ruleCount; i++) {
+                    if (rules[i].interval) {
+                        publishState(i);
+                    }
+                }
+            }
+            return;
+        }
+        String leader = name + "/timer/";
+        if (!topic.startsWith(leader) || !topic.endsWith("/state/get")) {
+            return;
+        }
+        int index = findRule(topic.substring(leader.length(), topic.length() - 10));
+        if (index != -1 && rules[index].interval && timeValid) {
+            publishState(index);
+        }
+    }
+};  // TimeScheduler
+
+const char *TimeScheduler::version = "0.1.0";
+
+}  // namespace ustd
@@ -11,14 +11,28 @@ mupplet-core implements the following classes based on the cooperative scheduler
 * * \ref ustd::Light
 * * \ref ustd::Switch
 * * \ref ustd::DigitalOut
+* * \ref ustd::DigitalOutBank
 * * \ref ustd::FrequencyCounter
 * * \ref ustd::LightsPCA9685
+* * \ref ustd::TimeScheduler
 * * \ref ustd::HomeAssistant
+* * \ref ustd::StateAggregator
+* * \ref ustd::StateReplay
+* * \ref ustd::StateCache
+* * \ref ustd::StateSnapshot
 
 Additionally there are implementation for the following helper classes:
 
 * * \ref ustd::LightController
 * * \ref ustd::Astro
+* * \ref ustd::OutputBackend
+* * \ref ustd::BitAngleModulator
+* * \ref ustd::ShiftRegister595
+* * \ref ustd::JsonWriter
+* * \ref ustd::StringPool
+* * \ref ustd::MuppletProfiler
+* * \ref ustd::AllocCounter
+* * \ref ustd::PublishFilter
 
 For an overview, see:
 <a href="https://github.com/muwerk/mupplet-core/blob/master/README.md">mupplet-core readme</a>
@@ -387,6 +401,204 @@ bool isNumber(const char *value, bool integer = false) {
     return true;
 }
 
+uint8_t formatUnsignedLong(char *buf, unsigned long value) {
+    /*! Format an unsigned integer value as decimal number
+     *
+     * Unlike `sprintf()` this does neither use the heap nor the `printf` family of the C library.
+     *
+     * @param buf       Buffer that receives the zero terminated text, must hold at least 11
+     *                  bytes (21 bytes on platforms with 64 bit `long`).
+     * @param value     The value to format
+     * @return The number of characters written (excluding the terminating zero)
+     */
+    char tmp[sizeof(unsigned long) * 3];
+    uint8_t n = 0;
+    do {
+        tmp[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    for (uint8_t i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    buf[n] = 0;
+    return n;
+}
+
+uint8_t formatLong(char *buf, long value) {
+    /*! Format an integer value as decimal number
+     *
+     * Unlike `sprintf()` this does neither use the heap nor the `printf` family of the C library.
+     *
+     * @param buf       Buffer that receives the zero terminated text, must hold at least 12
+     *                  bytes (22 bytes on platforms with 64 bit `long`).
+     * @param value     The value to format
+     * @return The number of characters written (excluding the terminating zero)
+     */
+    if (value < 0) {
+        *buf = '-';
+        return formatUnsignedLong(buf + 1, 0UL - (unsigned long)value) + 1;
+    }
+    return formatUnsignedLong(buf, (unsigned long)value);
+}
+
+uint8_t formatFixed(char *buf, double value, uint8_t decimals = 3) {
+    /*! Format a floating point value as fixed-point decimal number
+     *
+     * The value is rounded to the requested number of decimals, the result corresponds to
+     * `sprintf(buf, "%.3f", value)` for 3 decimals (values that are almost exactly halfway
+     * between two results may be rounded differently in the last digit). Unlike `sprintf()` this
+     * does neither use the heap nor the floating point `printf` code of the C library, which is
+     * slow and large on ESP8266.
+     *
+     * Values that are not a number or whose absolute value exceeds 4294967295 are formatted as
+     * `NaN`.
+     *
+     * @param buf       Buffer that receives the zero terminated text, must hold at least
+     *                  13 + decimals bytes.
+     * @param value     The value to format
+     * @param decimals  The number of decimals [0..9] (default: 3)
+     * @return The number of characters written (excluding the terminating zero)
+     */
+    static const uint32_t scales[] = {1,      10,      100,      1000,      10000,
+                                      100000, 1000000, 10000000, 100000000, 1000000000};
+    if (decimals > 9) {
+        decimals = 9;
+    }
+    bool negative = value < 0.0;
+    if (negative) {
+        value = -value;
+    }
+    if (!(value <= 4294967295.0)) {
+        // NaN, infinite or out of range
+        strcpy(buf, "NaN");
+        return 3;
+    }
+    uint32_t ipart = (uint32_t)value;
+    uint32_t scale = scales[decimals];
+    uint32_t fpart = (uint32_t)((value - (double)ipart) * (double)scale + 0.5);
+    if (fpart >= scale) {
+        // rounding carried over into the integer part
+        fpart -= scale;
+        if (ipart == 0xffffffffUL) {
+            strcpy(buf, "NaN");
+            return 3;
+        }
+        ++ipart;
+    }
+    uint8_t n = 0;
+    if (negative && (ipart || fpart)) {
+        buf[n++] = '-';
+    }
+    n += formatUnsignedLong(buf + n, ipart);
+    if (decimals) {
+        buf[n++] = '.';
+        for (uint8_t i = decimals; i > 0; i--) {
+            buf[n + i - 1] = '0' + fpart % 10;
+            fpart /= 10;
+        }
+        n += decimals;
+        buf[n] = 0;
+    }
+    return n;
+}
+
+uint8_t formatHex(char *buf, unsigned long value, uint8_t digits = 0) {
+    /*! Format an unsigned integer value as lowercase hexadecimal number
+     *
+     * Unlike `sprintf()` this does neither use the heap nor the `printf` family of the C library.
+     *
+     * @param buf       Buffer that receives the zero terminated text, must hold at least
+     *                  max(9, digits + 1) bytes (max(17, digits + 1) bytes on platforms with
+     *                  64 bit `long`).
+     * @param value     The value to format
+     * @param digits    Minimum number of digits, the number is padded with leading zeros
+     *                  (default: 0)
+     * @return The number of characters written (excluding the terminating zero)
+     */
+    static const char hex[] = "0123456789abcdef";
+    uint8_t n = 0;
+    for (unsigned long v = value; v; v >>= 4) {
+        ++n;
+    }
+    if (n < digits) {
+        n = digits;
+    }
+    if (n == 0) {
+        n = 1;
+    }
+    buf[n] = 0;
+    for (uint8_t i = n; i > 0; i--) {
+        buf[i - 1] = hex[value & 15];
+        value >>= 4;
+    }
+    return n;
+}
+
+uint32_t fnv1a(const uint8_t *data, uint16_t length, uint32_t hash = 2166136261UL) {
+    /*! Calculate the 32 bit FNV-1a hash of a block of data
+     *
+     * @param data      Pointer to the data
+     * @param length    Number of bytes to hash
+     * @param hash      Start value: the FNV offset basis (default) or the hash of the preceding
+     *                  data, to hash a concatenation without building it
+     * @return The FNV-1a hash
+     */
+    for (uint16_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+uint32_t fnv1a(const char *str, uint32_t hash = 2166136261UL) {
+    /*! Calculate the 32 bit FNV-1a hash of a zero terminated string
+     *
+     * @param str       The string to hash
+     * @param hash      Start value: the FNV offset basis (default) or the hash of the preceding
+     *                  data, to hash a concatenation without building it
+     * @return The FNV-1a hash
+     */
+    while (*str) {
+        hash = (hash ^ (uint8_t)*str++) * 16777619UL;
+    }
+    return hash;
+}
+
+#ifndef __ATTINY__
+template <typename T>
+T_SUBS msgHandler(T *pMupplet, void (T::*handler)(const String &topic, const String &msg,
+                                                  const String &originator)) {
+    /*! Create a subscription function that forwards messages to a message handler of a mupplet
+     *
+     * The scheduler passes topic, message and originator by value to the subscription
+     * function. A lambda that forwards them to a handler with `String` parameters copies all
+     * three strings once more, for every subscription that matches a message. The subscription
+     * function returned by `msgHandler()` passes them as constant references (non-owning views)
+     * to the handler instead. The handler may be a private method of the mupplet:
+     *
+     * \code{.cpp}
+     *     void begin(Scheduler *_pSched) {
+     *         ...
+     *         auto fnall = msgHandler(this, &MyMupplet::subsMsg);
+     *         pSched->subscribe(tID, name + "/#", fnall);
+     *         pSched->subscribe(tID, "mqtt/state", fnall);
+     *     }
+     *
+     *   private:
+     *     void subsMsg(const String &topic, const String &msg, const String &originator) {
+     *         ...
+     *     }
+     * \endcode
+     *
+     * @param pMupplet  Pointer to the mupplet
+     * @param handler   Message handler method of the mupplet
+     * @return The subscription function
+     */
+    return [pMupplet, handler](const String &topic, const String &msg, const String &originator) {
+        (pMupplet->*handler)(topic, msg, originator);
+    };
+}
+#endif
+
 String utf8ToLatin(String utf8string, char invalid_char = '_') {
     /*! Convert an arbitrary UTF-8 string into latin1 (ISO 8859-1)
      *
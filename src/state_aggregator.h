@@ -0,0 +1,232 @@
+// state_aggregator.h - muwerk State Aggregator
+#pragma once
+
+#include "muwerk.h"
+#include "mupplet_core.h"
+#include "helper/json_writer.h"
+
+#define USTD_FEATURE_STATE_AGGREGATOR
+
+namespace ustd {
+
+// clang-format off
+/*! \brief mupplet-core State Aggregator
+
+Every mupplet publishes one message per attribute (e.g. `state`, `unitbrightness`, `color`,
+`effect`...). The state aggregator collects the messages of registered mupplets and publishes
+all values in one JSON document. Changes are collected within a short window, so that a burst of
+attribute updates results in a single message.
+
+Command and request messages (topics ending in `/set` or `/get`) are ignored.
+
+If the \ref HomeAssistant Autodiscovery Helper is connected to the aggregator with
+\ref HomeAssistant::setStateAggregator, the entities of aggregated mupplets will use the
+aggregated state topic together with matching value templates.
+
+Optionally the aggregator can ask the MQTT module to stop forwarding the individual messages of
+registered mupplets to the MQTT server (message `mqtt/outgoingblock/set`), so that only the
+aggregated document reaches the broker. **Without blocking, the aggregated document is sent in
+addition to the individual messages and the broker traffic increases.** Blocking is off by
+default, since other MQTT clients may rely on the individual topics; it is switched on by
+\ref HomeAssistant::setStateAggregator or with \ref enableBlocking.
+
+## Messages
+
+### Messages sent by the state aggregator:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<topic>` | `{"led1/light/state":"on","led1/light/unitbrightness":"0.500",...}` | All collected values of all registered mupplets, keyed by topic.
+
+### Message received by the state aggregator:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `<topic>/get` | | Publishes the current document.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "state_aggregator.h"
+#include "home_assistant.h"
+#include "mup_light.h"
+
+ustd::Scheduler sched;
+ustd::StateAggregator agg;
+ustd::HomeAssistant ha("Tricorder", "Starfleet Engineering", "Tricorder Mark VII", "3.14.15");
+ustd::Light led("led1", D5);
+
+void setup() {
+    agg.begin(&sched);
+    agg.addMupplet("led1");
+    ha.setStateAggregator(&agg);  // only the aggregated document reaches the broker
+    ha.begin(&sched, true);
+    led.begin(&sched);
+    led.registerHomeAssistant(&ha);
+}
+\endcode
+*/
+// clang-format on
+class StateAggregator {
+  public:
+    static const char *version;  // = "0.1.0";
+
+  private:
+    // muwerk task management
+    Scheduler *pSched = nullptr;
+    int tID;
+
+    // configuration
+    String topic;
+    unsigned long windowMs;
+    bool blockIndividual;
+
+    // runtime
+    ustd::array<String> mupplets;
+    ustd::array<String> keys;
+    ustd::array<String> values;
+    JsonWriter json;
+    bool pending = false;
+    unsigned long firstChange = 0;
+
+  public:
+    StateAggregator(String topic = "state", unsigned long windowMs = 100,
+                    bool blockIndividual = false)
+        : topic(topic), windowMs(windowMs), blockIndividual(blockIndividual) {
+        /*! Instantiate a state aggregator
+
+        @param topic Topic of the aggregated JSON document
+        @param windowMs Time window in milliseconds in which changes are collected before the
+                        document is published
+        @param blockIndividual If `true`, the MQTT module is asked not to forward the individual
+                               messages of registered mupplets to the MQTT server. If `false`
+                               (default), the aggregated document adds to the broker traffic.
+        */
+    }
+
+    void begin(Scheduler *_pSched) {
+        /*! Start operation
+        @param _pSched Pointer to Scheduler object, used for internal task and pub/sub.
+        */
+        pSched = _pSched;
+        auto ft = [=]() { this->loop(); };
+        tID = pSched->add(ft, "aggregator", 10000);
+        pSched->subscribe(tID, topic + "/get",
+                          [this](const String &topic, const String &msg, const String &orig) {
+                              this->publish();
+                          });
+        for (unsigned int i = 0; i < mupplets.length(); i++) {
+            subscribeMupplet(mupplets[i]);
+        }
+    }
+
+    void addMupplet(String name) {
+        /*! Aggregate the messages of a mupplet
+        @param name Unique name of the mupplet
+        */
+        if (isAggregated(name) || mupplets.add(name) == -1) {
+            return;
+        }
+        if (pSched) {
+            subscribeMupplet(name);
+        }
+    }
+
+    void enableBlocking() {
+        /*! Ask the MQTT module not to forward the individual messages of registered mupplets
+
+        Only the aggregated document of registered mupplets reaches the MQTT server. Can be
+        called before or after \ref begin().
+        */
+        if (blockIndividual) {
+            return;
+        }
+        blockIndividual = true;
+        if (pSched) {
+            for (unsigned int i = 0; i < mupplets.length(); i++) {
+                pSched->publish("mqtt/outgoingblock/set", mupplets[i] + "/#");
+            }
+        }
+    }
+
+    bool isAggregated(String name) {
+        /*! Check if the messages of a mupplet are aggregated
+        @param name Unique name of the mupplet
+        @return `true` if the mupplet is registered with the aggregator
+        */
+        for (unsigned int i = 0; i < mupplets.length(); i++) {
+            if (mupplets[i] == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    String getTopic() {
+        /*! Get the topic of the aggregated JSON document
+        @return Topic of the aggregated document
+        */
+        return topic;
+    }
+
+  private:
+    void subscribeMupplet(String name) {
+        pSched->subscribe(tID, name + "/#", msgHandler(this, &StateAggregator::onMuppletMsg));
+        if (blockIndividual) {
+            pSched->publish("mqtt/outgoingblock/set", name + "/#");
+        }
+    }
+
+    void onMuppletMsg(const String &topic, const String &msg, const String &originator) {
+        if (originator == "mqtt" || topic.endsWith("/set") || topic.endsWith("/get")) {
+            return;
+        }
+        for (unsigned int i = 0; i < keys.length(); i++) {
+            if (keys[i] == topic) {
+                if (values[i] == msg) {
+                    return;
+                }
+                values[i] = msg;
+                changed();
+                return;
+            }
+        }
+        if (keys.add(topic) == -1) {
+            return;
+        }
+        values.add(msg);
+        changed();
+    }
+
+    void changed() {
+        if (!pending) {
+            pending = true;
+            firstChange = millis();
+        }
+    }
+
+    void publish() {
+        pending = false;
+        json.reset();
+        json.beginObject();
+        for (unsigned int i = 0; i < keys.length(); i++) {
+            json.add(keys[i].c_str(), values[i]);
+        }
+        json.endObject();
+        if (json.isValid()) {
+            pSched->publish(topic, json.c_str());
+        }
+    }
+
+    void loop() {
+        if (pending && timeDiff(firstChange, millis()) >= windowMs) {
+            publish();
+        }
+    }
+};  // StateAggregator
+
+const char *StateAggregator::version = "0.1.0";
+
+}  // namespace ustd
@@ -0,0 +1,225 @@
+// state_cache.h - muwerk State Cache
+#pragma once
+
+#include "muwerk.h"
+#include "mupplet_core.h"
+
+#define USTD_FEATURE_STATE_CACHE
+
+namespace ustd {
+
+// clang-format off
+/*! \brief mupplet-core State Cache
+
+Mupplets answer requests like `<mupplet-name>/light/state/get` by rebuilding and republishing
+their current state. The state cache keeps the last value of the state topics of registered
+mupplets, so that such requests can be answered directly from the cache: the mupplet only has
+to ask the cache with \ref answer() at the beginning of its message handler and can skip
+parsing and formatting completely if the cache was able to answer.
+
+Only topics that a mupplet registers explicitly with \ref addTopic() are cached, together with
+the request they answer. A mupplet only registers topics that it publishes on every change of
+their value; a request that is answered with several topics (e.g. `unitbrightness` and
+`state`) is answered with all of them in the order of registration. Requests that are not
+registered or whose values are not all known fall through to the mupplet.
+
+Only values that the mupplet published itself are answered: mupplets publish their state without
+originator, a message of another producer with an originator (e.g. a message received from the
+MQTT server) marks the cached value as stale until the mupplet publishes the topic again. A
+mupplet whose state changes without a publish (e.g. the automatic modes of a light) or that
+changes the set of topics it publishes (e.g. \ref Switch on a mode change) calls
+\ref invalidate(), so that the old values are no longer answered.
+
+Mupplets that support the state cache provide a `registerStateCache()` method.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "state_cache.h"
+#include "mup_switch.h"
+
+ustd::Scheduler sched;
+ustd::StateCache cache;
+ustd::Switch button("button", D6);
+
+void setup() {
+    cache.begin(&sched);
+    button.begin(&sched);
+    button.registerStateCache(&cache);
+}
+\endcode
+*/
+// clang-format on
+class StateCache {
+  public:
+    static const char *version;  // = "0.1.0";
+
+  private:
+    typedef struct {
+        uint32_t hash;
+        String topic;
+        String value;
+        bool valid;  // false if the last value was not published by the mupplet
+    } Entry;
+
+    typedef struct {
+        uint32_t hash;
+        String request;  // e.g. `led1/light/unitbrightness/get`
+        uint16_t entry;  // index of a topic that answers the request
+    } Request;
+
+    // muwerk task management
+    Scheduler *pSched = nullptr;
+    int tID;
+
+    // runtime
+    ustd::array<Entry> entries;
+    ustd::array<Request> requests;
+
+  public:
+    StateCache() {
+        /*! Instantiate a state cache */
+    }
+
+    void begin(Scheduler *_pSched) {
+        /*! Start operation
+        @param _pSched Pointer to Scheduler object, used for internal task and pub/sub.
+        */
+        pSched = _pSched;
+        tID = pSched->add([]() {}, "statecache", 1000000);
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            subscribeTopic(entries[i].topic);
+        }
+    }
+
+    void addTopic(const String &topic, const String &request = "") {
+        /*! Cache a state topic of a mupplet and answer a request with it
+
+        Usually this is not called directly, but by the `registerStateCache()` method of a
+        mupplet. The mupplet must publish the topic on every change of its value.
+
+        @param topic Topic that is cached, e.g. `led1/light/state`
+        @param request Topic of the request that is answered with the cached value, default is
+                       `<topic>/get`. Several topics can be added for the same request.
+        */
+        String req = request == "" ? topic + "/get" : request;
+        uint32_t h = fnv1a(topic.c_str());
+        int index = find(topic, h);
+        if (index == -1) {
+            Entry entry = {h, topic, "", false};
+            index = entries.add(entry);
+            if (index == -1) {
+                return;
+            }
+            if (pSched) {
+                subscribeTopic(topic);
+            }
+        }
+        Request r = {fnv1a(req.c_str()), req, (uint16_t)index};
+        requests.add(r);
+    }
+
+    bool answer(const String &topic) {
+        /*! Answer a request from the cache
+
+        @param topic Topic of the request, e.g. `led1/light/state/get`
+        @return `true` if the request was answered with the cached values of all its topics,
+                `false` if the request is not registered or a value is not known.
+        */
+        if (!pSched || !topic.endsWith("/get")) {
+            return false;
+        }
+        uint32_t h = fnv1a(topic.c_str());
+        bool found = false;
+        for (unsigned int i = 0; i < requests.length(); i++) {
+            if (requests[i].hash == h && requests[i].request == topic) {
+                if (!entries[requests[i].entry].valid) {
+                    return false;
+                }
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        for (unsigned int i = 0; i < requests.length(); i++) {
+            if (requests[i].hash == h && requests[i].request == topic) {
+                Entry &entry = entries[requests[i].entry];
+                pSched->publish(entry.topic, entry.value);
+            }
+        }
+        return true;
+    }
+
+    bool republish(const String &topic) {
+        /*! Publish the cached value of a topic
+
+        @param topic Topic of the cached message, e.g. `led1/light/state`
+        @return `true` if the value was published, `false` if no value is cached
+        */
+        int index = find(topic, fnv1a(topic.c_str()));
+        if (index == -1 || !entries[index].valid || !pSched) {
+            return false;
+        }
+        pSched->publish(entries[index].topic, entries[index].value);
+        return true;
+    }
+
+    void invalidate(const String &prefix) {
+        /*! Stop answering requests with the cached values of a mupplet
+
+        The values are answered again once the mupplet has published them again.
+
+        @param prefix Name of the mupplet (all its requests) or the beginning of the request
+                      topics that are affected, e.g. `lights/light/3`
+        */
+        String start = prefix + "/";
+        for (unsigned int i = 0; i < requests.length(); i++) {
+            if (requests[i].request.startsWith(start)) {
+                entries[requests[i].entry].valid = false;
+            }
+        }
+    }
+
+    unsigned int getSize() {
+        /*! Get the number of cached topics
+        @return Number of cached topics
+        */
+        return entries.length();
+    }
+
+  private:
+    int find(const String &topic, uint32_t h) {
+        for (unsigned int i = 0; i < entries.length(); i++) {
+            if (entries[i].hash == h && entries[i].topic == topic) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void subscribeTopic(const String &topic) {
+        pSched->subscribe(tID, topic, msgHandler(this, &StateCache::onStateMsg));
+    }
+
+    void onStateMsg(const String &topic, const String &msg, const String &originator) {
+        int index = find(topic, fnv1a(topic.c_str()));
+        if (index == -1) {
+            return;
+        }
+        Entry &entry = entries[index];
+        if (originator != "") {
+            // published by another producer: the cached value is no longer the current one
+            entry.valid = false;
+            return;
+        }
+        entry.value = msg;
+        entry.valid = true;
+    }
+};  // StateCache
+
+const char *StateCache::version = "0.1.0";
+
+}  // namespace ustd
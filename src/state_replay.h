@@ -0,0 +1,210 @@
+// state_replay.h - muwerk State Replay Coordinator
+#pragma once
+
+#include "muwerk.h"
+#include "mupplet_core.h"
+
+#define USTD_FEATURE_STATE_REPLAY
+
+namespace ustd {
+
+// clang-format off
+/*! \brief mupplet-core State Replay Coordinator
+
+When the connection to the MQTT server is (re-)established, every mupplet republishes its full
+state. Without coordination, all mupplets do this in the same scheduler cycle: with many
+mupplets, the resulting burst of messages can overflow the outgoing queue of the MQTT client
+and messages get lost.
+
+Mupplets that are registered with the state replay coordinator do not republish their state
+on their own. Instead the coordinator calls the registered replay functions after the message
+`mqtt/state` `connected` has been received, spread over several scheduler cycles: at most
+`rate` replay functions are called every `interval` microseconds. Replay functions with a
+lower priority value are called first; replay functions with identical priority are called in
+the order of registration.
+
+If the connection is lost while a replay is in progress, the replay is aborted. It starts from
+the beginning on the next connect.
+
+## Messages
+
+### Messages sent by the state replay coordinator:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `replay/state` | `running`, `done` | Sent when a replay starts and when all replay functions have been called.
+
+### Message received by the state replay coordinator:
+
+| topic | message body | comment
+| ----- | ------------ | -------
+| `mqtt/state` | `connected`, `disconnected` | Starts or aborts a replay
+| `replay/set` | | Starts a replay, e.g. to refresh all states on the MQTT server
+| `replay/state/get` | | Publishes the current state on `replay/state`
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "state_replay.h"
+#include "mup_switch.h"
+#include "mup_light.h"
+
+ustd::Scheduler sched;
+ustd::StateReplay replay(2);   // 2 replays per cycle
+ustd::Switch button("button", D6);
+ustd::Light led("led1", D5);
+
+void setup() {
+    replay.begin(&sched);
+    button.begin(&sched);
+    button.registerStateReplay(&replay, 10);   // the button state is replayed first
+    led.begin(&sched);
+    led.registerStateReplay(&replay);
+}
+\endcode
+*/
+// clang-format on
+class StateReplay {
+  public:
+    static const char *version;  // = "0.1.0";
+#if defined(__ESP__) || defined(__UNIXOID__)
+    /*! Replay function: publishes the full state of a mupplet */
+    typedef std::function<void()> T_REPLAY;
+#elif defined(__ATTINY__)
+    typedef void (*T_REPLAY)();
+#else
+    typedef ustd::function<void()> T_REPLAY;
+#endif
+
+  private:
+    typedef struct {
+        T_REPLAY replay;
+        uint8_t priority;
+    } Entry;
+
+    // muwerk task management
+    Scheduler *pSched = nullptr;
+    int tID;
+
+    // configuration
+    uint8_t rate;
+    ustd::array<Entry> entries;
+
+    // runtime
+    bool running = false;
+    unsigned int next = 0;
+
+  public:
+    StateReplay(uint8_t rate = 4) : rate(rate ? rate : 1) {
+        /*! Instantiate a state replay coordinator
+
+        @param rate Maximum number of replay functions that are called per scheduler cycle
+        */
+    }
+
+    void begin(Scheduler *_pSched, unsigned long intervalUs = 20000) {
+        /*! Start operation
+        @param _pSched Pointer to Scheduler object, used for internal task and pub/sub.
+        @param intervalUs Interval in microseconds in which the replay functions are called
+        */
+        pSched = _pSched;
+        auto ft = [=]() { this->loop(); };
+        tID = pSched->add(ft, "replay", intervalUs);
+        auto fnall = msgHandler(this, &StateReplay::subsMsg);
+        pSched->subscribe(tID, "mqtt/state", fnall);
+        pSched->subscribe(tID, "replay/#", fnall);
+    }
+
+    int add(T_REPLAY fn, uint8_t priority = 128) {
+        /*! Register a replay function
+
+        Usually this is not called directly, but by the `registerStateReplay()` method of a
+        mupplet.
+
+        @param fn Function that publishes the full state of a mupplet
+        @param priority Priority of the replay function: lower values are replayed first
+        @return Index of the registered function or -1 if no more functions can be registered
+        */
+        Entry entry = {fn, priority};
+        int index = entries.add(entry);
+        if (index == -1) {
+            return -1;
+        }
+        // keep the entries ordered by priority (stable for identical priorities)
+        while (index > 0 && entries[index - 1].priority > priority) {
+            entries[index] = entries[index - 1];
+            --index;
+        }
+        entries[index] = entry;
+        if (running && (unsigned int)index < next) {
+            // registered during a replay in front of the current position: skip it
+            ++next;
+        }
+        return index;
+    }
+
+    void setRate(uint8_t _rate) {
+        /*! Set the replay rate
+        @param _rate Maximum number of replay functions that are called per scheduler cycle
+        */
+        rate = _rate ? _rate : 1;
+    }
+
+    void replay() {
+        /*! Start a replay of all registered functions
+
+        A replay that is already in progress is restarted.
+        */
+        running = true;
+        next = 0;
+        publishState();
+    }
+
+    bool isReplaying() {
+        /*! Check if a replay is in progress
+        @return `true` if not all replay functions have been called yet
+        */
+        return running;
+    }
+
+  private:
+    void publishState() {
+        if (pSched) {
+            pSched->publish("replay/state", running ? "running" : "done");
+        }
+    }
+
+    void loop() {
+        if (!running) {
+            return;
+        }
+        for (uint8_t i = 0; i < rate && next < entries.length(); i++) {
+            // advance first: the replay function may register further functions
+            entries[next++].replay();
+        }
+        if (next >= entries.length()) {
+            running = false;
+            publishState();
+        }
+    }
+
+    void subsMsg(const String &topic, const String &msg, const String &originator) {
+        if (topic == "mqtt/state") {
+            if (msg == "connected") {
+                replay();
+            } else if (running) {
+                running = false;
+            }
+        } else if (topic == "replay/set") {
+            replay();
+        } else if (topic == "replay/state/get") {
+            publishState();
+        }
+    }
+};  // StateReplay
+
+const char *StateReplay::version = "0.1.0";
+
+}  // namespace ustd
@@ -0,0 +1,327 @@
+// state_snapshot.h - muwerk State Snapshot
+#pragma once
+
+#include "muwerk.h"
+#include "mupplet_core.h"
+#ifdef USTD_FEATURE_FILESYSTEM
+#include "jsonfile.h"
+#endif
+
+#define USTD_FEATURE_STATE_SNAPSHOT
+
+#ifndef USTD_SNAPSHOT_SIZE
+#define USTD_SNAPSHOT_SIZE 256  //!< size of the snapshot in bytes, including a 12 byte header
+#endif
+#ifndef USTD_SNAPSHOT_RTC_OFFSET
+#define USTD_SNAPSHOT_RTC_OFFSET 32  //!< ESP8266: offset in RTC user memory in 4 byte blocks
+#endif
+
+namespace ustd {
+
+// clang-format off
+/*! \brief mupplet-core State Snapshot
+
+After a reboot, mupplets start with the defaults of their constructor and only get their
+previous state back when the retained MQTT messages arrive, seconds after Wi-Fi and MQTT are
+up. The state snapshot keeps a compact binary copy of the state of registered mupplets (e.g.
+brightness, mode, effect, color and counters) in memory that survives a reboot. Mupplets read
+their snapshot in `begin()`, before they write to the hardware for the first time, so the
+outputs come up with the previous state.
+
+The snapshot is stored in RTC memory, which survives software resets, watchdog resets and deep
+sleep, but not a loss of power:
+
+* ESP8266: RTC user memory, starting at block `USTD_SNAPSHOT_RTC_OFFSET` (default 32, the first
+  128 bytes are left to the OTA update)
+* ESP32: a `RTC_NOINIT_ATTR` variable in RTC slow memory
+
+Optionally (with `USTD_FEATURE_FILESYSTEM`), the snapshot is also saved to the flash
+filesystem as `snapshot/data`, which is used if the RTC memory does not contain a valid
+snapshot (e.g. after a power loss). To limit the wear of the flash memory, it is written at
+most every `flashInterval` seconds and only if the snapshot has changed.
+
+State changes only update the snapshot in RAM, RTC memory is written by the snapshot task
+in its interval (batched). The size of all snapshots is limited to `USTD_SNAPSHOT_SIZE`
+(default 256 bytes); each mupplet uses its state size plus 5 bytes.
+
+Mupplets that support state snapshots provide a `registerStateSnapshot()` method that
+**must** be called before the `begin()` method of the mupplet.
+
+## Sample Integration
+
+\code{cpp}
+#define __ESP__ 1   // Platform defines required, see ustd library doc, mainpage.
+#include "scheduler.h"
+#include "state_snapshot.h"
+#include "mup_light.h"
+
+ustd::Scheduler sched;
+ustd::StateSnapshot snapshot;
+ustd::Light led("led1", D5);
+
+void setup() {
+    snapshot.begin(&sched);
+    led.registerStateSnapshot(&snapshot);  // before led.begin()!
+    led.begin(&sched);
+}
+\endcode
+*/
+// clang-format on
+class StateSnapshot {
+  public:
+    static const char *version;  // = "0.1.0";
+
+  private:
+    static const uint32_t magic = 0x6d755353;  // "muSS"
+    static const uint16_t headerSize = 12;     // magic, used, reserved, checksum
+    static const uint16_t recordHeaderSize = 5;  // name hash, size
+
+    // muwerk task management
+    Scheduler *pSched = nullptr;
+    int tID;
+
+    // configuration
+    unsigned long flashInterval;
+
+    // runtime
+    uint32_t buffer[(USTD_SNAPSHOT_SIZE + 3) / 4];
+    uint16_t used = headerSize;
+    bool loaded = false;
+    bool dirty = false;
+    bool flashDirty = false;
+    unsigned long lastFlashWrite = 0;
+#ifdef USTD_FEATURE_FILESYSTEM
+    jsonfile config;
+#endif
+
+  public:
+    StateSnapshot(unsigned long flashInterval = 300) : flashInterval(flashInterval) {
+        /*! Instantiate a state snapshot
+
+        @param flashInterval Minimum interval in seconds between two writes of the snapshot to
+                             the flash filesystem, 0 disables the flash copy. Only used with
+                             `USTD_FEATURE_FILESYSTEM`.
+        */
+    }
+
+    void begin(Scheduler *_pSched, unsigned long intervalUs = 200000) {
+        /*! Start operation
+        @param _pSched Pointer to Scheduler object, used for internal task.
+        @param intervalUs Interval in microseconds in which changes are written to RTC memory
+        */
+        pSched = _pSched;
+        auto ft = [=]() { this->loop(); };
+        tID = pSched->add(ft, "snapshot", intervalUs);
+        load();
+    }
+
+    bool restore(const String &name, void *pData, uint8_t size) {
+        /*! Read the snapshot of a mupplet
+
+        Usually this is not called directly, but by the `begin()` method of a mupplet.
+
+        @param name Unique name of the mupplet
+        @param pData Pointer to the state of the mupplet that receives the snapshot
+        @param size Size of the state
+        @return `true` if a snapshot of the same size was found and copied to `pData`
+        */
+        load();
+        int offset = find(fnv1a(name.c_str()));
+        if (offset == -1 || bytes()[offset + 4] != size) {
+            return false;
+        }
+        memcpy(pData, bytes() + offset + recordHeaderSize, size);
+        return true;
+    }
+
+    bool update(const String &name, const void *pData, uint8_t size) {
+        /*! Update the snapshot of a mupplet
+
+        Usually this is not called directly, but by a mupplet on a change of its state. If
+        the state did not change, nothing is written.
+
+        @param name Unique name of the mupplet
+        @param pData Pointer to the state of the mupplet
+        @param size Size of the state, must be identical on every call
+        @return `true` on success, `false` if there is no space left in the snapshot
+        */
+        load();
+        uint32_t id = fnv1a(name.c_str());
+        uint8_t *p = bytes();
+        int offset = find(id);
+        if (offset != -1 && p[offset + 4] != size) {
+            // the state size changed (new firmware): replace the record
+            uint16_t length = recordHeaderSize + p[offset + 4];
+            memmove(p + offset, p + offset + length, used - offset - length);
+            used -= length;
+            offset = -1;
+        }
+        if (offset == -1) {
+            if (used + recordHeaderSize + size > USTD_SNAPSHOT_SIZE) {
+                return false;
+            }
+            offset = used;
+            memcpy(p + offset, &id, 4);
+            p[offset + 4] = size;
+            used += recordHeaderSize + size;
+        } else if (!memcmp(p + offset + recordHeaderSize, pData, size)) {
+            return true;
+        }
+        memcpy(p + offset + recordHeaderSize, pData, size);
+        dirty = true;
+        flashDirty = true;
+        return true;
+    }
+
+    void clear() {
+        /*! Remove the snapshots of all mupplets
+
+        The next reboot starts with the default states of all mupplets.
+        */
+        used = headerSize;
+        loaded = true;
+        dirty = true;
+        flashDirty = true;
+    }
+
+    void flush() {
+        /*! Write the snapshot to RTC memory (and flash) immediately
+
+        Useful before a planned restart.
+        */
+        writeRtc();
+#ifdef USTD_FEATURE_FILESYSTEM
+        if (flashInterval && flashDirty) {
+            writeFlash();
+        }
+#endif
+    }
+
+  private:
+    uint8_t *bytes() {
+        return (uint8_t *)buffer;
+    }
+
+#if defined(__ESP32__)
+    static uint32_t *rtcBuffer() {
+        // function-local: a global in the header would be defined by every translation unit
+        static RTC_NOINIT_ATTR uint32_t rtc[(USTD_SNAPSHOT_SIZE + 3) / 4];
+        return rtc;
+    }
+#endif
+
+    int find(uint32_t id) {
+        uint8_t *p = bytes();
+        uint16_t offset = headerSize;
+        while (offset < used) {
+            if (!memcmp(p + offset, &id, 4)) {
+                return offset;
+            }
+            offset += recordHeaderSize + p[offset + 4];
+        }
+        return -1;
+    }
+
+    bool validate() {
+        uint16_t length = bytes()[4] | (bytes()[5] << 8);
+        if (buffer[0] != magic || length < headerSize || length > USTD_SNAPSHOT_SIZE) {
+            return false;
+        }
+        if (buffer[2] != fnv1a(bytes() + headerSize, length - headerSize)) {
+            return false;
+        }
+        used = length;
+        return true;
+    }
+
+    void load() {
+        if (loaded) {
+            return;
+        }
+        loaded = true;
+#if defined(__ESP32__)
+        memcpy(buffer, rtcBuffer(), sizeof(buffer));
+        if (validate()) {
+            return;
+        }
+#elif defined(__ESP__)
+        if (ESP.rtcUserMemoryRead(USTD_SNAPSHOT_RTC_OFFSET, buffer, sizeof(buffer)) &&
+            validate()) {
+            return;
+        }
+#endif
+#ifdef USTD_FEATURE_FILESYSTEM
+        if (flashInterval && readFlash() && validate()) {
+            // write the flash copy to RTC memory on the next loop
+            dirty = true;
+            return;
+        }
+#endif
+        used = headerSize;
+    }
+
+    void seal() {
+        uint8_t *p = bytes();
+        buffer[0] = magic;
+        p[4] = used & 0xff;
+        p[5] = used >> 8;
+        p[6] = p[7] = 0;
+        buffer[2] = fnv1a(p + headerSize, used - headerSize);
+    }
+
+    void writeRtc() {
+        seal();
+#if defined(__ESP32__)
+        memcpy(rtcBuffer(), buffer, (used + 3) & ~3);
+#elif defined(__ESP__)
+        ESP.rtcUserMemoryWrite(USTD_SNAPSHOT_RTC_OFFSET, buffer, (used + 3) & ~3);
+#endif
+        dirty = false;
+    }
+
+#ifdef USTD_FEATURE_FILESYSTEM
+    bool readFlash() {
+        String hex = config.readString("snapshot/data");
+        if (hex.length() < 2 * headerSize || hex.length() > 2 * USTD_SNAPSHOT_SIZE) {
+            return false;
+        }
+        uint8_t *p = bytes();
+        for (unsigned int i = 0; i < hex.length() / 2; i++) {
+            p[i] = (hexDigit(hex[2 * i]) << 4) | hexDigit(hex[2 * i + 1]);
+        }
+        return true;
+    }
+
+    void writeFlash() {
+        char hex[2 * USTD_SNAPSHOT_SIZE + 1];
+        uint8_t *p = bytes();
+        seal();
+        for (uint16_t i = 0; i < used; i++) {
+            formatHex(hex + 2 * i, p[i], 2);
+        }
+        config.writeString("snapshot/data", hex);
+        lastFlashWrite = millis();
+        flashDirty = false;
+    }
+
+    static uint8_t hexDigit(char c) {
+        return c >= 'a' ? c - 'a' + 10 : c >= 'A' ? c - 'A' + 10 : c - '0';
+    }
+#endif
+
+    void loop() {
+        if (dirty) {
+            writeRtc();
+        }
+#ifdef USTD_FEATURE_FILESYSTEM
+        if (flashInterval && flashDirty &&
+            timeDiff(lastFlashWrite, millis()) > flashInterval * 1000UL) {
+            writeFlash();
+        }
+#endif
+    }
+};  // StateSnapshot
+
+const char *StateSnapshot::version = "0.1.0";
+
+}  // namespace ustd